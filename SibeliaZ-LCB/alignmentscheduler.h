@@ -0,0 +1,155 @@
+#ifndef _ALIGNMENT_SCHEDULER_H_
+#define _ALIGNMENT_SCHEDULER_H_
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <exception>
+#include <algorithm>
+#include <condition_variable>
+
+#include <tbb/task_arena.h>
+
+namespace Sibelia
+{
+	// Runs alignment jobs on a pool of threads so that the sum of the memory
+	// estimates of the running jobs stays within a budget. The largest jobs
+	// are started first, the small ones are handed out in batches. Jobs that
+	// split their work run it in the arena of the scheduler, which all the
+	// workers share, so together they never use more than its threads.
+	class AlignmentScheduler
+	{
+	public:
+		static const uint64_t SMALL_JOB = uint64_t(1) << 20;
+		static const size_t SMALL_BATCH = 64;
+
+		// A budget of 0 bytes means no limit
+		AlignmentScheduler(size_t threads, uint64_t budget) : threads_(std::max(threads, size_t(1))), budget_(budget), used_(0), arena_(static_cast<int>(threads_))
+		{
+
+		}
+
+		tbb::task_arena & GetArena()
+		{
+			return arena_;
+		}
+
+		uint64_t GetBudget() const
+		{
+			return budget_;
+		}
+
+		// A rough upper bound of spoa's memory for a global alignment: three
+		// 32-bit DP matrices of graph nodes by the longest copy, plus the graph
+		// and the rows. Every copy after the longest one is assumed to add about
+		// an eighth of its length to the graph.
+		static uint64_t EstimateMemory(uint64_t maxLength, uint64_t totalLength)
+		{
+			uint64_t nodes = maxLength + (totalLength - maxLength) / 8;
+			return 12 * nodes * maxLength + 128 * nodes + 2 * totalLength;
+		}
+
+		// Calls f(job) for every job whose estimate fits the budget and sets
+		// admitted[job] accordingly. A job that throws is marked in failed[job]
+		// and the others go on, so a block running out of memory doesn't end
+		// the run. Returns when all admitted jobs are done.
+		template<class F>
+		void Run(const std::vector<uint64_t> & estimate, std::vector<bool> & admitted, std::vector<char> & failed, F f)
+		{
+			std::vector<size_t> order;
+			admitted.assign(estimate.size(), false);
+			failed.assign(estimate.size(), 0);
+			for (size_t i = 0; i < estimate.size(); i++)
+			{
+				if (budget_ == 0 || estimate[i] <= budget_)
+				{
+					admitted[i] = true;
+					order.push_back(i);
+				}
+			}
+
+			std::stable_sort(order.begin(), order.end(), [&estimate](size_t a, size_t b) { return estimate[a] > estimate[b]; });
+			std::vector<size_t> batch;
+			for (size_t i = 0; i < order.size();)
+			{
+				batch.push_back(i);
+				size_t j = i + 1;
+				if (estimate[order[i]] < SMALL_JOB)
+				{
+					for (; j < order.size() && j - i < SMALL_BATCH; j++);
+				}
+
+				i = j;
+			}
+
+			batch.push_back(order.size());
+			std::atomic<size_t> next(0);
+			std::vector<std::thread> worker;
+			for (size_t t = 0; t < std::min(threads_, batch.size() - 1); t++)
+			{
+				worker.push_back(std::thread([&]()
+				{
+					for (size_t now = next++; now + 1 < batch.size(); now = next++)
+					{
+						// Batches are sorted, the first job of a batch is its largest
+						uint64_t reserve = estimate[order[batch[now]]];
+						Acquire(reserve);
+						for (size_t i = batch[now]; i < batch[now + 1]; i++)
+						{
+							try
+							{
+								f(order[i]);
+							}
+							catch (std::exception &)
+							{
+								failed[order[i]] = 1;
+							}
+						}
+
+						Release(reserve);
+					}
+				}));
+			}
+
+			for (auto & t : worker)
+			{
+				t.join();
+			}
+		}
+
+	private:
+		void Acquire(uint64_t bytes)
+		{
+			if (budget_ > 0)
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				free_.wait(lock, [this, bytes]() { return used_ + bytes <= budget_; });
+				used_ += bytes;
+			}
+		}
+
+		void Release(uint64_t bytes)
+		{
+			if (budget_ > 0)
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					used_ -= bytes;
+				}
+
+				free_.notify_all();
+			}
+		}
+
+		size_t threads_;
+		uint64_t budget_;
+		uint64_t used_;
+		std::mutex mutex_;
+		std::condition_variable free_;
+		tbb::task_arena arena_;
+	};
+}
+
+#endif
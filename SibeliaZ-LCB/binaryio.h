@@ -0,0 +1,67 @@
+#ifndef _BINARY_IO_H_
+#define _BINARY_IO_H_
+
+#include <vector>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+namespace Sibelia
+{
+	// Values are stored in the native byte order, containers as a 64-bit
+	// length followed by the elements
+	template<class T>
+	T ReadBinary(std::istream & in)
+	{
+		T ret = T();
+		in.read(reinterpret_cast<char*>(&ret), sizeof(ret));
+		return ret;
+	}
+
+	template<class T>
+	void WriteBinary(std::ostream & out, T value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	// Reads a length of items taking at least itemBytes each in the file. A
+	// length the rest of the file can't hold fails the stream and reads as 0,
+	// so a corrupt file is reported as truncated instead of exhausting memory.
+	inline uint64_t ReadBinaryLength(std::istream & in, uint64_t itemBytes)
+	{
+		uint64_t length = ReadBinary<uint64_t>(in);
+		std::streampos now = in.tellg();
+		in.seekg(0, std::ios::end);
+		std::streampos end = in.tellg();
+		in.seekg(now);
+		if (!in || now < 0 || end < now || length > uint64_t(end - now) / itemBytes)
+		{
+			in.setstate(std::ios::failbit);
+			return 0;
+		}
+
+		return length;
+	}
+
+	template<class C>
+	void ReadBinaryVector(std::istream & in, C & data)
+	{
+		data.resize(ReadBinaryLength(in, sizeof(data[0])));
+		if (!data.empty())
+		{
+			in.read(reinterpret_cast<char*>(&data[0]), data.size() * sizeof(data[0]));
+		}
+	}
+
+	template<class C>
+	void WriteBinaryVector(std::ostream & out, const C & data)
+	{
+		WriteBinary(out, uint64_t(data.size()));
+		if (!data.empty())
+		{
+			out.write(reinterpret_cast<const char*>(&data[0]), data.size() * sizeof(data[0]));
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef _BLOCK_ALIGNER_H_
+#define _BLOCK_ALIGNER_H_
+
+#include <new>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <tbb/task_arena.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <spoa/spoa.hpp>
+
+namespace Sibelia
+{
+	// Global partial order alignment of the copies of a block, scored the same
+	// way as `spoa -l 1 -r 1` used by the sibeliaz script. One aligner must not
+	// be shared between threads.
+	class BlockAligner
+	{
+	public:
+		BlockAligner() : engine_(spoa::createAlignmentEngine(spoa::AlignmentType::kNW, 5, -4, -8, -6))
+		{
+
+		}
+
+		// Fills row with the gapped copies in the input order. Returns false if
+		// the block could not be aligned, e.g. there was not enough memory.
+		bool Align(const std::vector<std::string> & sequence, std::vector<std::string> & row)
+		{
+			row.clear();
+			try
+			{
+				auto graph = spoa::createGraph();
+				for (const std::string & seq : sequence)
+				{
+					auto alignment = engine_->align(seq, graph);
+					graph->add_alignment(alignment, seq);
+				}
+
+				graph->generate_multiple_alignment(row);
+			}
+			catch (std::bad_alloc &)
+			{
+				row.clear();
+			}
+
+			return row.size() == sequence.size();
+		}
+
+		// Aligns a block piecewise: anchor[a][c] is the offset of a k-mer shared
+		// by all copies in copy c, offsets increase with a. Anchors become gapless
+		// columns and only the segments between them are aligned, in parallel in
+		// arena, so time and memory follow the longest segment instead of the
+		// whole block.
+		static bool AlignAnchored(const std::vector<std::string> & sequence, const std::vector<std::vector<uint64_t> > & anchor, size_t k, tbb::task_arena & arena, std::vector<std::string> & row)
+		{
+			size_t copies = sequence.size();
+			std::vector<std::vector<std::string> > segmentRow(anchor.size() + 1);
+			arena.execute([&]()
+			{
+				tbb::parallel_for(tbb::blocked_range<size_t>(0, segmentRow.size(), 1), [&](const tbb::blocked_range<size_t> & range)
+				{
+					BlockAligner aligner;
+					std::vector<std::string> segment(copies);
+					for (size_t s = range.begin(); s != range.end(); s++)
+					{
+						for (size_t c = 0; c < copies; c++)
+						{
+							uint64_t start = s == 0 ? 0 : anchor[s - 1][c] + k;
+							uint64_t end = s == anchor.size() ? sequence[c].size() : anchor[s][c];
+							segment[c].assign(sequence[c], start, end - start);
+						}
+
+						aligner.AlignSegment(segment, segmentRow[s]);
+					}
+				});
+			});
+
+			row.assign(copies, std::string());
+			for (size_t s = 0; s < segmentRow.size(); s++)
+			{
+				if (segmentRow[s].size() != copies)
+				{
+					row.clear();
+					return false;
+				}
+
+				for (size_t c = 0; c < copies; c++)
+				{
+					row[c] += segmentRow[s][c];
+					if (s < anchor.size())
+					{
+						row[c].append(sequence[c], anchor[s][c], k);
+					}
+				}
+			}
+
+			return true;
+		}
+
+	private:
+		// Like Align, but copies may be empty and then become gap-only rows
+		bool AlignSegment(const std::vector<std::string> & sequence, std::vector<std::string> & row)
+		{
+			std::vector<size_t> present;
+			std::vector<std::string> nonEmpty;
+			for (size_t i = 0; i < sequence.size(); i++)
+			{
+				if (!sequence[i].empty())
+				{
+					present.push_back(i);
+					nonEmpty.push_back(sequence[i]);
+				}
+			}
+
+			std::vector<std::string> aligned;
+			if (nonEmpty.size() > 1 && !Align(nonEmpty, aligned))
+			{
+				row.clear();
+				return false;
+			}
+
+			if (nonEmpty.size() == 1)
+			{
+				aligned = nonEmpty;
+			}
+
+			size_t width = aligned.empty() ? 0 : aligned[0].size();
+			row.assign(sequence.size(), std::string(width, '-'));
+			for (size_t i = 0; i < present.size(); i++)
+			{
+				row[present[i]].swap(aligned[i]);
+			}
+
+			return true;
+		}
+
+		BlockAligner(const BlockAligner &);
+		BlockAligner & operator = (const BlockAligner &);
+
+		std::unique_ptr<spoa::AlignmentEngine> engine_;
+	};
+}
+
+#endif
@@ -267,73 +267,58 @@ namespace Sibelia
 	{
 		std::ofstream out;
 		TryOpenFile(fileName, out);
+		OutputBuffer buffer(out);
 		std::vector<IndexPair> group;
 		BlockList blockList = block;
 		GroupBy(blockList, compareByChrId, std::back_inserter(group));
 		for (std::vector<IndexPair>::iterator it = group.begin(); it != group.end(); ++it)
 		{
-			out.setf(std::ios_base::showpos);
 			size_t length = it->second - it->first;
 			size_t chr = blockList[it->first].GetChrId();
-			out << '>' << storage_.GetChrDescription(chr) << std::endl;
+			buffer << '>' << storage_.GetChrDescription(chr) << '\n';
 			std::sort(blockList.begin() + it->first, blockList.begin() + it->second);
 			for (auto jt = blockList.begin() + it->first; jt < blockList.begin() + it->first + length; ++jt)
 			{
-				out << jt->GetSignedBlockId() << " ";
+				buffer << (jt->GetSignedBlockId() > 0 ? "+" : "") << int64_t(jt->GetSignedBlockId()) << ' ';
 			}
 
-			out << "$" << std::endl;
-		}
-	}
-
-	template<class It>
-	std::string Join(It start, It end, const std::string & delimiter)
-	{
-		It last = --end;
-		std::stringstream ss;
-		for (; start != end; ++start)
-		{
-			ss << *start << delimiter;
+			buffer << "$\n";
 		}
 
-		ss << *last;
-		return ss.str();
+		buffer.Flush();
 	}
 
-
-	void BlocksFinder::ListBlocksIndicesGFF(const BlockList & blockList, const std::string & fileName) const
+	size_t BlocksFinder::ListBlocksIndicesGFF(const std::string & fileName, bool sortById) const
 	{
 		std::ofstream out;
 		TryOpenFile(fileName, out);
-		BlockList block(blockList);
-		std::sort(block.begin(), block.end(), compareById);
-		const std::string header[] =
+		OutputBuffer buffer(out);
+		buffer << "##gff-version 2\n";
+		buffer << "##source-version SibeliaZ " << VERSION << '\n';
+		buffer << "##Type DNA\n";
+		size_t totalLength = 0;
+		auto record = [this, &buffer, &totalLength](const BlockInstance & instance)
 		{
-			"##gff-version 2",
-			std::string("##source-version SibeliaZ ") + VERSION,
-			"##Type DNA"
+			buffer << storage_.GetChrDescription(instance.GetChrId()) << "\tSibeliaZ\tLCB_copy\t";
+			buffer << uint64_t(instance.GetStart() + 1) << '\t' << uint64_t(instance.GetEnd());
+			buffer << (instance.GetDirection() ? "\t.\t+\t.\tid=" : "\t.\t-\t.\tid=") << uint64_t(instance.GetBlockId()) << '\n';
+			totalLength += instance.GetLength();
 		};
 
-		out << Join(header, header + 3, "\n") << std::endl;
-		for (BlockList::const_iterator it = block.begin(); it != block.end(); ++it)
+		if (sortById)
 		{
-			size_t start = it->GetStart() + 1;
-			size_t end = it->GetEnd();
-			const std::string record[] =
+			ForEachBlock(OUTPUT_BUCKET_SIZE, [&record](BlockList::const_iterator begin, BlockList::const_iterator end)
 			{
-				storage_.GetChrDescription(it->GetChrId()), 
-				"SibeliaZ",
-				"LCB_copy",
-				IntToStr(start),
-				IntToStr(end),
-				".",
-				(it->GetDirection() ? "+" : "-"),
-				".",
-				"id=" + IntToStr(static_cast<size_t>(it->GetBlockId()))
-			};
-
-			out << Join(record, record + sizeof(record) / sizeof(record[0]), "\t") << std::endl;
+				std::for_each(begin, end, record);
+			});
+		}
+		else
+		{
+			ForEachInstance(record);
 		}
+
+		buffer.Flush();
+		return totalLength;
 	}
 
 	void BlocksFinder::TryOpenFile(const std::string & fileName, std::ofstream & stream) const
@@ -1,4 +1,4 @@
-#ifndef _TRASERVAL_H_
+#ifndef _TRAVERSAL_H_
 #define _TRAVERSAL_H_
 
 //#define _DEBUG_OUT_
@@ -7,18 +7,31 @@
 #include <map>
 #include <list>
 #include <ctime>
+#include <chrono>
 #include <queue>
+#include <random>
 #include <iterator>
 #include <cassert>
 #include <numeric>
 #include <sstream>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <functional>
 #include <unordered_map>
+#include <condition_variable>
 
 #include <tbb/parallel_for.h>
+#include <tbb/spin_rw_mutex.h>
 
 #include "path.h"
+#include "regions.h"
+#include "checkpoint.h"
+#include "progresstracker.h"
+#include "blockaligner.h"
+#include "mafwriter.h"
+#include "alignmentscheduler.h"
+#include "outputgenerator.h"
 
 namespace Sibelia
 {
@@ -55,6 +68,10 @@ namespace Sibelia
 	namespace
 	{
 		const bool COVERED = true;
+		const size_t OUTPUT_BUCKET_SIZE = size_t(1) << 22;
+		const size_t ALIGNMENT_WINDOW_PER_THREAD = 16;
+		const uint64_t ALIGNMENT_WINDOW_LENGTH = uint64_t(1) << 28;
+		const unsigned SHUFFLE_SEED = 1;
 		typedef std::vector<BlockInstance> BlockList;
 		typedef std::pair<size_t, std::vector<BlockInstance> > GroupedBlock;
 		typedef std::vector<GroupedBlock> GroupedBlockList;
@@ -63,13 +80,6 @@ namespace Sibelia
 			return a.first < b.first;
 		}
 
-		std::string IntToStr(size_t x)
-		{
-			std::stringstream ss;
-			ss << x;
-			return ss.str();
-		}
-
 		template<class Iterator1, class Iterator2>
 		void CopyN(Iterator1 it, size_t count, Iterator2 out)
 		{
@@ -177,14 +187,150 @@ namespace Sibelia
 
 	void CreateOutDirectory(const std::string & path);
 
+	class BlocksFinderBenchmark;
+
 	class BlocksFinder
 	{
 	public:
 
 		BlocksFinder(JunctionStorage & storage, size_t k) : storage_(storage), k_(k)
 		{
-			progressCount_ = 50;
-			scoreFullChains_ = true;			
+			scoreFullChains_ = true;
+			pruning_ = false;
+			numa_ = 0;
+			baseline_ = 0;
+			regions_ = 0;
+			bundles_ = 0;
+			threads_ = 1;
+			align_ = false;
+			alignThreads_ = 0;
+			alignMemory_ = 0;
+			anchorLength_ = 0;
+			compressMaf_ = false;
+			partition_ = 0;
+			partitions_ = 1;
+			checkpointInterval_ = 0;
+			statusInterval_ = 0;
+			verbose_ = true;
+			resume_ = false;
+			report_ = 0;
+		}
+
+		// Phases of the search and the output and the array sizes are added to report
+		void SetReport(RunReport * report)
+		{
+			report_ = report;
+		}
+
+		// Saves the state of the search to fileName every interval seconds. With
+		// resume the search continues from the checkpoint if there is one.
+		void SetCheckpoint(const std::string & fileName, size_t interval, bool resume)
+		{
+			checkpointFileName_ = fileName;
+			checkpointInterval_ = interval;
+			resume_ = resume;
+		}
+
+		// The progress of the search is written to fileName every interval seconds
+		void SetStatus(const std::string & fileName, size_t interval)
+		{
+			statusFileName_ = fileName;
+			statusInterval_ = interval;
+		}
+
+		int64_t GetBlocksFound() const
+		{
+			return blocksFound_;
+		}
+
+		// Without verbose the search prints nothing to the console
+		void SetVerbose(bool verbose)
+		{
+			verbose_ = verbose;
+		}
+
+		// Only every partitions-th seed of the common shuffled order is searched,
+		// starting from the partition-th one
+		void SetPartition(size_t partition, size_t partitions)
+		{
+			partition_ = partition;
+			partitions_ = partitions;
+		}
+
+		void SetPruning(bool pruning)
+		{
+			pruning_ = pruning;
+		}
+
+		void SetBundles(size_t bundles)
+		{
+			bundles_ = bundles;
+		}
+
+		// Aligns the blocks with threads threads when the output is generated,
+		// 0 means as many as the search used. The estimated memory of the blocks
+		// aligned at once is kept under memory bytes, 0 means no limit.
+		void SetAlignment(bool align, int64_t threads = 0, uint64_t memory = 0)
+		{
+			align_ = align;
+			alignThreads_ = threads;
+			alignMemory_ = memory;
+		}
+
+		// Blocks with a copy of at least length are aligned piecewise between
+		// the junctions shared by all copies, 0 disables it
+		void SetAnchoredAlignment(uint64_t length)
+		{
+			anchorLength_ = length;
+		}
+
+		// Writes the alignment as BGZF-compressed alignment.maf.gz
+		void SetMafCompression(bool compress)
+		{
+			compressMaf_ = compress;
+		}
+
+		// Continues the saved run the storage was built from: its blocks are
+		// restored, the new genomes get instances of the blocks their junctions
+		// map to, and only vertices occurring in the new genomes seed the search
+		void SetBaseline(const LcbIndex * baseline)
+		{
+			baseline_ = baseline;
+		}
+
+		// Only vertices with a junction overlapping the regions seed the search,
+		// and only blocks intersecting them are kept
+		void SetRegions(const RegionSet * regions)
+		{
+			regions_ = regions;
+		}
+
+		void SaveIndex(const std::string & fileName) const
+		{
+			LcbIndex::Writer writer(fileName, k_, blocksFound_, storage_.GetChrNumber());
+			for (size_t chr = 0; chr < size_t(storage_.GetChrNumber()); chr++)
+			{
+				LcbIndex::Chromosome now;
+				now.description = storage_.GetChrDescription(chr);
+				now.sequence = storage_.GetChrSequence(chr);
+				for (size_t idx = 0; idx < size_t(storage_.GetChrVerticesCount(chr)); idx++)
+				{
+					JunctionStorage::JunctionSequentialIterator it = storage_.GetIterator(chr, idx);
+					now.id.push_back(int32_t(it.GetVertexId()));
+					now.pos.push_back(uint32_t(it.GetPosition()));
+					now.block.push_back(blockId_[chr][idx].block);
+					now.instance.push_back(blockId_[chr][idx].instance);
+				}
+
+				writer.WriteChromosome(now);
+			}
+
+			writer.Close();
+		}
+
+		void SetNumaTopology(const NumaTopology * numa)
+		{
+			numa_ = numa;
 		}
 
 		struct ProcessVertex
@@ -206,15 +352,14 @@ namespace Sibelia
 				Path currentPath(finder.storage_, finder.maxBranchSize_, finder.minBlockSize_, finder.minBlockSize_, finder.maxFlankingSize_);
 				for (size_t i = range.begin(); i != range.end(); i++)
 				{
-					if (finder.count_++ % finder.progressPortion_ == 0)
+					finder.progress_.SeedDone();
+					int64_t score;
+					int64_t vid = shuffle[i];
+					if (finder.IsSeedProcessed(vid))
 					{
-						finder.progressMutex_.lock();
-						std::cout << '.' << std::flush;
-						finder.progressMutex_.unlock();
+						continue;
 					}
 
-					int64_t score;
-					int64_t vid = shuffle[i];
 #ifdef _DEBUG_OUT_
 					finder.debug_ = finder.missingVertex_.count(vid);
 					if (finder.debug_)
@@ -222,6 +367,15 @@ namespace Sibelia
 						std::cerr << "Vid: " << vid << std::endl;
 					}
 #endif
+					SIBELIAZ_COUNT(SEEDS_PROCESSED, 1);
+					if (!finder.HasFreeInstances(vid))
+					{
+						SIBELIAZ_COUNT(SEEDS_SKIPPED, 1);
+						finder.seedsSkipped_++;
+						finder.MarkSeedProcessed(vid);
+						continue;
+					}
+
 					for (bool explore = true; explore;)
 					{
 						currentPath.Init(vid);
@@ -249,6 +403,10 @@ namespace Sibelia
 							while ((ret = finder.ExtendPathForward(currentPath, count, data, bestRightSize, bestScore, score)) && currentPath.MiddlePathLength() - prevLength <= minRun)
 							{
 								positive = positive || (score > 0);
+								if (!positive && finder.PruneRun(currentPath, true, currentPath.MiddlePathLength() - prevLength, minRun))
+								{
+									break;
+								}
 							}
 
 							if (!ret || !positive)
@@ -282,7 +440,8 @@ namespace Sibelia
 							bool ret = true;
 							bool positive = false;
 							int64_t prevLength = currentPath.MiddlePathLength();
-							while ((ret = finder.ExtendPathBackward(currentPath, count, data, bestLeftSize, bestScore, score)) && currentPath.MiddlePathLength() - prevLength <= minRun);
+							while ((ret = finder.ExtendPathBackward(currentPath, count, data, bestLeftSize, bestScore, score)) && currentPath.MiddlePathLength() - prevLength <= minRun &&
+								(score > 0 || !finder.PruneRun(currentPath, false, currentPath.MiddlePathLength() - prevLength, minRun)));
 							{
 								positive = positive || (score > 0);
 							}
@@ -315,277 +474,1319 @@ namespace Sibelia
 
 						currentPath.Clear();
 					}
+
+					finder.MarkSeedProcessed(vid);
 				}
 			}
 		};
 
-		static bool DegreeCompare(const JunctionStorage & storage, int64_t v1, int64_t v2)
+		size_t SeedBit(int64_t vid) const
 		{
-			return storage.GetInstancesCount(v1) > storage.GetInstancesCount(v2);
+			return size_t(vid + storage_.GetVerticesNumber() - 1);
 		}
 
-		void Split(std::string & source, std::vector<std::string> & result)
+		bool IsSeedProcessed(int64_t vid) const
 		{
-			std::stringstream ss;
-			ss << source;
-			result.clear();
-			while (ss >> source)
+			return !seedDone_.empty() && ((__atomic_load_n(&seedDone_[SeedBit(vid) >> 6], __ATOMIC_ACQUIRE) >> (SeedBit(vid) & 63)) & 1);
+		}
+
+		void MarkSeedProcessed(int64_t vid)
+		{
+			if (!seedDone_.empty())
 			{
-				result.push_back(source);
+				__atomic_fetch_or(&seedDone_[SeedBit(vid) >> 6], uint64_t(1) << (SeedBit(vid) & 63), __ATOMIC_RELEASE);
 			}
 		}
 
-		void FindBlocks(int64_t minBlockSize, int64_t maxBranchSize, int64_t maxFlankingSize, int64_t lookingDepth, int64_t sampleSize, int64_t threads, const std::string & debugOut)
+		// Identifies the seeds and the parameters of the search, so a checkpoint
+		// is never resumed by a different run
+		uint64_t Fingerprint(const std::vector<int64_t> & shuffle) const
 		{
-			blocksFound_ = 0;
-			sampleSize_ = sampleSize;
-			lookingDepth_ = lookingDepth;
-			minBlockSize_ = minBlockSize;
-			maxBranchSize_ = maxBranchSize;
-			maxFlankingSize_ = maxFlankingSize;
-			blockId_.resize(storage_.GetChrNumber());
-			for (int64_t i = 0; i < storage_.GetChrNumber(); i++)
+			uint64_t ret = 14695981039346656037ULL;
+			std::vector<int64_t> value(shuffle);
+			value.push_back(minBlockSize_);
+			value.push_back(maxBranchSize_);
+			value.push_back(maxFlankingSize_);
+			value.push_back(pruning_);
+			for (int64_t chr = 0; chr < storage_.GetChrNumber(); chr++)
 			{
-				blockId_[i].resize(storage_.GetChrVerticesCount(i));
+				value.push_back(storage_.GetChrVerticesCount(chr));
 			}
 
-			std::vector<int64_t> shuffle;
-			for (int64_t v = -storage_.GetVerticesNumber() + 1; v < storage_.GetVerticesNumber(); v++)
+			for (int64_t now : value)
 			{
-				for (JunctionStorage::JunctionIterator it(v); it.Valid(); ++it)
+				for (size_t i = 0; i < sizeof(now); i++)
 				{
-					if (it.IsPositiveStrand())
-					{
-						shuffle.push_back(v);
-						break;
-					}
+					ret = (ret ^ ((uint64_t(now) >> (8 * i)) & 0xff)) * 1099511628211ULL;
 				}
 			}
 
-			using namespace std::placeholders;
-			std::random_shuffle(shuffle.begin(), shuffle.end());
-
-			time_t mark = time(0);
-			count_ = 0;
-			std::cout << '[' << std::flush;
-			progressPortion_ = shuffle.size() / progressCount_;
-			tbb::task_scheduler_init init(static_cast<int>(threads));
-			tbb::parallel_for(tbb::blocked_range<size_t>(0, shuffle.size()), ProcessVertex(*this, shuffle));
-			std::cout << ']' << std::endl;
-			//std::cout << "Time: " << time(0) - mark << std::endl;
+			return ret;
 		}
 
-		
-		void ListBlocksSequences(const BlockList & block, const std::string & directory) const
+		// Keeps the seeds that have a junction overlapping a region, every seed
+		// if seed is empty. The junctions of a region are found by binary search.
+		void RestrictSeeds(std::vector<bool> & seed) const
 		{
-			std::vector<IndexPair> group;
-			BlockList blockList = block;
-			GroupBy(blockList, compareById, std::back_inserter(group));
-			for (std::vector<IndexPair>::iterator it = group.begin(); it != group.end(); ++it)
-			{
-				std::ofstream out;
-				std::stringstream ss;
-				ss << directory << "/" << blockList[it->first].GetBlockId() << ".fa";
-				TryOpenFile(ss.str(), out);
-				for (size_t block = it->first; block < it->second; block++)
-				{
-					size_t length = blockList[block].GetLength();
-					size_t chr = blockList[block].GetChrId();
-					size_t chrSize = storage_.GetChrSequence(chr).size();
-					out << ">" << blockList[block].GetBlockId() << "_" << block - it->first << " ";
-					out << storage_.GetChrDescription(chr) << ";";
-					if (blockList[block].GetSignedBlockId() > 0)
-					{
-						out << blockList[block].GetStart() << ";" << length << ";" << "+;" << chrSize << std::endl;
-						OutputLines(storage_.GetChrSequence(chr).begin() + blockList[block].GetStart(), length, out);
-					}
-					else
+			std::vector<bool> inside(storage_.GetVerticesNumber(), false);
+			for (size_t chr = 0; chr < size_t(storage_.GetChrNumber()); chr++)
+			{
+				for (const RegionSet::Interval & region : regions_->GetRegions(chr))
+				{
+					size_t idx = storage_.LowerBound(chr, region.first >= uint64_t(k_) ? region.first - k_ + 1 : 0);
+					for (; idx < size_t(storage_.GetChrVerticesCount(chr)) && uint64_t(storage_.GetIterator(chr, idx).GetPosition()) < region.second; idx++)
 					{
-						size_t start = chrSize - blockList[block].GetEnd();
-						out << start << ";" << length << ";" << "-;" << chrSize << std::endl;
-						std::string::const_reverse_iterator it(storage_.GetChrSequence(chr).begin() + blockList[block].GetEnd());
-						OutputLines(CFancyIterator(it, TwoPaCo::DnaChar::ReverseChar, ' '), length, out);
+						inside[abs(storage_.GetIterator(chr, idx).GetVertexId())] = true;
 					}
-
-					out << std::endl;
 				}
 			}
-		}
 
+			for (size_t v = 0; v < seed.size(); v++)
+			{
+				inside[v] = inside[v] && (seed.empty() || seed[v]);
+			}
+
+			seed.swap(inside);
+		}
 
-		void GenerateOutput(const std::string & outDir, bool genSeq) const
+		// Unassigns the blocks without an instance intersecting a region, their
+		// ids are left unused
+		void DropBlocksOutsideRegions()
 		{
-			BlockList instance;
-			std::vector<std::vector<bool> > covered(storage_.GetChrNumber());
-			for (size_t i = 0; i < covered.size(); i++)
+			std::vector<bool> keep(blocksFound_ + 1, false);
+			ForEachInstance([&](const BlockInstance & instance)
 			{
-				covered[i].assign(storage_.GetChrSequence(i).size(), false);
-			}
+				if (regions_->Intersects(instance.GetChrId(), instance.GetStart(), instance.GetEnd()))
+				{
+					keep[instance.GetBlockId()] = true;
+				}
+			});
 
-			for (size_t chr = 0; chr < blockId_.size(); chr++)
+			for (std::vector<Assignment> & chr : blockId_)
 			{
-				for (size_t i = 0; i < blockId_[chr].size();)
+				for (Assignment & now : chr)
 				{
-					if (storage_.GetIterator(chr, i).IsUsed())
-					{
-						int64_t bid = blockId_[chr][i].block;
-						size_t j = i;
-						for (; j < blockId_[chr].size() && blockId_[chr][i] == blockId_[chr][j]; j++);
-						j--;
-						int64_t start = storage_.GetIterator(chr, i, bid > 0).GetPosition() + (bid > 0 ? 0 : -k_);
-						int64_t end = storage_.GetIterator(chr, j, bid > 0).GetPosition() + (bid > 0 ? k_ : 0);
-						instance.push_back(BlockInstance(int(bid), chr, size_t(start), size_t(end)));
-						i = j + 1;
-					}
-					else
+					if (!keep[abs(now.block)])
 					{
-						++i;
+						now = Assignment();
 					}
 				}
 			}
 
-			std::cout.setf(std::cout.fixed);
-			std::cout.precision(2);
-			std::cout << "Blocks found: " << blocksFound_ << std::endl;
-			std::cout << "Total coverage: " << CalculateCoverage(instance) << std::endl;
-
+			if (verbose_)
+			{
+				std::cout << "Blocks intersecting the regions: " << std::count(keep.begin(), keep.end(), true) << std::endl;
+			}
+		}
 
-			CreateOutDirectory(outDir);
-			std::string blocksDir = outDir + "/blocks";
-			ListBlocksIndicesGFF(instance, outDir + "/" + "blocks_coords.gff");
-			if (genSeq)
+		// Blocks restored from a checkpoint or a saved run count as found
+		void StartProgress(size_t seeds)
+		{
+			uint64_t bp = 0;
+			uint64_t positions = 0;
+			uint64_t bpTotal = 0;
+			for (size_t chr = 0; chr < blockId_.size(); chr++)
 			{
-				CreateOutDirectory(blocksDir);
-				ListBlocksSequences(instance, blocksDir);
+				bpTotal += storage_.GetChrSequence(chr).size();
+				for (const Assignment & now : blockId_[chr])
+				{
+					positions += now.block != 0 ? 1 : 0;
+				}
 			}
 
-	//		GenerateReport(instance, outDir + "/" + "coverage_report.txt");*/
-	//		ListBlocksIndices(instance, outDir + "/" + "blocks_coords.txt");
+			ForEachInstance([&bp](const BlockInstance & instance) { bp += instance.GetLength(); });
+			progress_.Start(seeds, storage_.GetPositionsNumber(), bpTotal, blocksFound_, positions, bp, statusFileName_, statusInterval_, verbose_);
 		}
 
+		// Blocks are only written under the shared side of stateMutex_, so the
+		// copy holds whole blocks. A seed is marked after its blocks are
+		// written; the blocks of a seed still running are copied as well, and
+		// searching it again on resume finds the rest of them. The lock is held
+		// only for the bulk copy of the assignment: a position is marked used
+		// exactly when it gets a block, so the used bits are derived after.
+		// Each chromosome of the copy is coded and freed in turn.
+		void SaveCheckpoint(uint64_t fingerprint)
+		{
+			Checkpoint checkpoint;
+			std::vector<std::vector<Assignment> > assignment(blockId_.size());
+			{
+				tbb::spin_rw_mutex::scoped_lock lock(stateMutex_, true);
+				checkpoint.fingerprint = fingerprint;
+				checkpoint.blocksFound = blocksFound_;
+				checkpoint.seed.resize(seedDone_.size());
+				for (size_t i = 0; i < seedDone_.size(); i++)
+				{
+					checkpoint.seed[i] = __atomic_load_n(&seedDone_[i], __ATOMIC_ACQUIRE);
+				}
 
-	private:
+				for (size_t chr = 0; chr < blockId_.size(); chr++)
+				{
+					assignment[chr] = blockId_[chr];
+				}
+			}
 
-		template<class Iterator>
-		void OutputLines(Iterator start, size_t length, std::ostream & out) const
-		{
-			for (size_t i = 1; i <= length; i++, ++start)
+			checkpoint.chr.resize(assignment.size());
+			for (size_t chr = 0; chr < assignment.size(); chr++)
 			{
-				out << *start;
-				if (i % 80 == 0 && i != length)
+				Checkpoint::Chromosome & now = checkpoint.chr[chr];
+				Checkpoint::Encoder encoder(now);
+				now.used.assign((assignment[chr].size() + 63) / 64, 0);
+				for (size_t idx = 0; idx < assignment[chr].size(); idx++)
 				{
-					out << std::endl;
+					now.used[idx >> 6] |= uint64_t(assignment[chr][idx].block != 0 ? 1 : 0) << (idx & 63);
+					encoder.Encode(assignment[chr][idx].block, assignment[chr][idx].instance);
 				}
+
+				std::vector<Assignment>().swap(assignment[chr]);
 			}
-		}
 
-		double CalculateCoverage(const BlockList & block) const;
-		void GenerateReport(const BlockList & block, const std::string & fileName) const;
-		void CalculateCoverage(GroupedBlockList::const_iterator start, GroupedBlockList::const_iterator end, std::vector<double> & ret) const;
-		std::string OutputIndex(const BlockInstance & block) const;
-		void OutputBlocks(const std::vector<BlockInstance>& block, std::ofstream& out) const;
-		void ListBlocksIndices(const BlockList & block, const std::string & fileName) const;
-		void ListBlocksIndicesGFF(const BlockList & blockList, const std::string & fileName) const;
-		void ListChromosomesAsPermutations(const BlockList & block, const std::string & fileName) const;
-		void TryOpenFile(const std::string & fileName, std::ofstream & stream) const;
-		void ListChrs(std::ostream & out) const;
+			try
+			{
+				checkpoint.Save(checkpointFileName_);
+			}
+			catch (std::runtime_error & e)
+			{
+				std::cerr << "Warning: " << e.what() << std::endl;
+			}
+		}
 
-		template<class T>
-		void DumpVertex(int64_t id, std::ostream & out, T & visit, int64_t cnt = 5) const
+		void RestoreCheckpoint(const Checkpoint & checkpoint)
 		{
-			for (auto kt = JunctionStorage::JunctionIterator(id); kt.Valid(); ++kt)
+			bool match = checkpoint.chr.size() == blockId_.size() && checkpoint.seed.size() == seedDone_.size();
+			for (size_t chr = 0; match && chr < blockId_.size(); chr++)
 			{
-				auto jt = kt.SequentialIterator();
-				for (int64_t i = 0; i < cnt; i++)
+				match = checkpoint.chr[chr].positions == blockId_[chr].size() && checkpoint.chr[chr].used.size() == (blockId_[chr].size() + 63) / 64;
+			}
+
+			if (!match)
+			{
+				throw std::runtime_error("The checkpoint does not match the graph");
+			}
+
+			seedDone_ = checkpoint.seed;
+			blocksFound_ = checkpoint.blocksFound;
+			for (size_t chr = 0; chr < blockId_.size(); chr++)
+			{
+				const Checkpoint::Chromosome & now = checkpoint.chr[chr];
+				Checkpoint::Decoder decoder(now);
+				for (size_t idx = 0; idx < blockId_[chr].size(); idx++)
 				{
-					auto it = jt - 1;
-					auto pr = std::make_pair(it, jt);
-					if (it.Valid() && std::find(visit.begin(), visit.end(), pr) == visit.end())
+					decoder.Decode(blockId_[chr][idx].block, blockId_[chr][idx].instance);
+					if ((now.used[idx >> 6] >> (idx & 63)) & 1)
 					{
-						int64_t length = it.GetPosition() - jt.GetPosition();
-						out << it.GetVertexId() << " -> " << jt.GetVertexId()
-							<< "[label=\"" << it.GetChar() << ", " << it.GetChrId() << ", " << it.GetPosition() << "," << length << "\""
-							<< (it.IsPositiveStrand() ? "color=blue" : "color=red") << "]\n";
-						visit.push_back(pr);
+						storage_.GetIterator(chr, idx).MarkUsed();
 					}
-
-					jt = it;
 				}
 			}
+		}
 
-			for (auto kt = JunctionStorage::JunctionIterator(id); kt.Valid(); ++kt)
+		// Copies the saved assignment to the positions that survived the rebuild
+		// and marks them used. Returns the number of the saved chromosomes.
+		size_t RestoreBaseline()
+		{
+			blocksFound_ = baseline_->blocksFound;
+			for (size_t chr = 0; chr < baseline_->chr.size(); chr++)
 			{
-				auto it = kt.SequentialIterator();
-				for (int64_t i = 0; i < cnt; i++)
+				const LcbIndex::Chromosome & saved = baseline_->chr[chr];
+				size_t idx = 0;
+				for (size_t i = 0; i < saved.pos.size(); i++)
 				{
-					auto jt = it + 1;
-					auto pr = std::make_pair(it, jt);
-					if (jt.Valid() && std::find(visit.begin(), visit.end(), pr) == visit.end())
+					for (; idx < blockId_[chr].size() && storage_.GetIterator(chr, idx).GetPosition() < int64_t(saved.pos[i]); idx++);
+					if (idx < blockId_[chr].size() && storage_.GetIterator(chr, idx).GetPosition() == int64_t(saved.pos[i]) && saved.block[i] != 0)
 					{
-						int64_t length = it.GetPosition() - jt.GetPosition();
-						out << it.GetVertexId() << " -> " << jt.GetVertexId()
-							<< "[label=\"" << it.GetChar() << ", " << it.GetChrId() << ", " << it.GetPosition() << "," << length << "\""
-							<< (it.IsPositiveStrand() ? "color=blue" : "color=red") << "]\n";
-						visit.push_back(pr);
+						blockId_[chr][idx].block = saved.block[i];
+						blockId_[chr][idx].instance = saved.instance[i];
+						storage_.GetIterator(chr, idx).MarkUsed();
 					}
-
-					it = jt;
 				}
 			}
+
+			return baseline_->chr.size();
 		}
 
-		bool TryFinalizeBlock(const Path & currentPath, Path & finalizer, size_t bestRightSize, size_t bestLeftSize)
+		// A junction of a new genome votes for the block that holds most of its
+		// occurrences in the saved genomes, oriented along the new genome. Runs of
+		// junctions voting for the same block that span at least minBlockSize_
+		// become new instances of that block. Repeat vertices don't vote. The
+		// new instances are numbered after every saved one, so chained
+		// incremental runs never reuse an instance id.
+		void ProjectBaseline(size_t firstNewChr)
 		{
-			bool ret = false;
-			std::vector<Path::InstanceSet::const_iterator> lockInstance;
-			for (auto it : currentPath.GoodInstancesList())
+			int32_t instance = 0;
+			for (const LcbIndex::Chromosome & saved : baseline_->chr)
 			{
-				lockInstance.push_back(it);
+				for (size_t i = 0; i < saved.block.size(); i++)
+				{
+					if (saved.block[i] != 0)
+					{
+						instance = max(instance, saved.instance[i] + 1);
+					}
+				}
 			}
-			
-			std::sort(lockInstance.begin(), lockInstance.end(), Path::CmpInstance);
+
+			for (size_t chr = firstNewChr; chr < size_t(storage_.GetChrNumber()); chr++)
 			{
-				std::pair<size_t, size_t> idx(SIZE_MAX, SIZE_MAX);
-				for (auto & instance : lockInstance)
+				std::vector<int32_t> vote(blockId_[chr].size(), 0);
+				for (size_t idx = 0; idx < vote.size(); idx++)
 				{
-					if (instance->Front().IsPositiveStrand())
+					std::map<int32_t, size_t> count;
+					int64_t vid = storage_.GetIterator(chr, idx).GetVertexId();
+					for (JunctionStorage::JunctionIterator it(vid); it.Valid() && !storage_.IsRepeat(vid); ++it)
 					{
-						storage_.LockRange(instance->Front(), instance->Back(), idx);
+						if (it.GetChrId() < firstNewChr && blockId_[it.GetChrId()][it.GetIndex()].block != 0)
+						{
+							int32_t block = blockId_[it.GetChrId()][it.GetIndex()].block;
+							count[it.IsPositiveStrand() ? block : -block]++;
+						}
 					}
-					else
+
+					size_t best = 0;
+					for (auto & now : count)
 					{
-						storage_.LockRange(instance->Back().Reverse(), instance->Front().Reverse(), idx);
+						if (now.second > best)
+						{
+							best = now.second;
+							vote[idx] = now.first;
+						}
 					}
 				}
-			}
-		
-			finalizer.Init(currentPath.Origin());
-			for (size_t i = 0; i < bestRightSize - 1 && finalizer.PointPushBack(currentPath.RightPoint(i).GetEdge()); i++);
-			for (size_t i = 0; i < bestLeftSize - 1 && finalizer.PointPushFront(currentPath.LeftPoint(i).GetEdge()); i++);
-			if (finalizer.Score() > 0 && finalizer.GoodInstances() > 1)
-			{
-				ret = true;
-				int64_t instanceCount = 0;
-				int64_t currentBlock = ++blocksFound_;	
-				for (auto jt : finalizer.AllInstances())
+
+				for (size_t idx = 0; idx < vote.size();)
 				{
-					if (finalizer.IsGoodInstance(*jt))
+					size_t end = idx + 1;
+					for (; end < vote.size() && vote[end] == vote[idx]; end++);
+					int64_t length = storage_.GetIterator(chr, end - 1).GetPosition() + int64_t(k_) - storage_.GetIterator(chr, idx).GetPosition();
+					if (vote[idx] != 0 && length >= minBlockSize_)
 					{
-						auto it = jt->Front();
-						do
+						for (size_t i = idx; i < end; i++)
 						{
-							it.MarkUsed();							
-							int64_t idx = it.GetIndex();
-							int64_t maxidx = storage_.GetChrVerticesCount(it.GetChrId());
-							blockId_[it.GetChrId()][it.GetIndex()].block = int32_t(it.IsPositiveStrand() ? +currentBlock : -currentBlock);
-							blockId_[it.GetChrId()][it.GetIndex()].instance = int32_t(instanceCount);
-
-						} while (it++ != jt->Back());
+							blockId_[chr][i].block = vote[idx];
+							blockId_[chr][i].instance = instance;
+							storage_.GetIterator(chr, i).MarkUsed();
+						}
 
-						instanceCount++;
+						instance++;
 					}
+
+					idx = end;
 				}
 			}
+		}
+
+		static bool DegreeCompare(const JunctionStorage & storage, int64_t v1, int64_t v2)
+		{
+			return storage.GetInstancesCount(v1) > storage.GetInstancesCount(v2);
+		}
+
+		void Split(std::string & source, std::vector<std::string> & result)
+		{
+			std::stringstream ss;
+			ss << source;
+			result.clear();
+			while (ss >> source)
+			{
+				result.push_back(source);
+			}
+		}
+
+		void FindBlocks(int64_t minBlockSize, int64_t maxBranchSize, int64_t maxFlankingSize, int64_t lookingDepth, int64_t sampleSize, int64_t threads, const std::string & debugOut)
+		{
+			std::unique_ptr<RunReport::Phase> seeding(new RunReport::Phase(report_, "seed_shuffle"));
+			InitSearch(minBlockSize, maxBranchSize, maxFlankingSize, lookingDepth, sampleSize, threads);
+			std::vector<bool> seed;
+			if (baseline_ != 0)
+			{
+				size_t firstNewChr = RestoreBaseline();
+				ProjectBaseline(firstNewChr);
+				seed.assign(storage_.GetVerticesNumber(), false);
+				for (size_t chr = firstNewChr; chr < size_t(storage_.GetChrNumber()); chr++)
+				{
+					for (size_t idx = 0; idx < size_t(storage_.GetChrVerticesCount(chr)); idx++)
+					{
+						seed[abs(storage_.GetIterator(chr, idx).GetVertexId())] = true;
+					}
+				}
+			}
+
+			if (regions_ != 0)
+			{
+				RestrictSeeds(seed);
+			}
+
+			// Repeat vertices only extend the paths started from the others
+			std::vector<int64_t> shuffle;
+			for (int64_t v = -storage_.GetVerticesNumber() + 1; v < storage_.GetVerticesNumber(); v++)
+			{
+				if ((!seed.empty() && !seed[abs(v)]) || storage_.IsRepeat(v))
+				{
+					continue;
+				}
+
+				for (JunctionStorage::JunctionIterator it(v); it.Valid(); ++it)
+				{
+					if (it.IsPositiveStrand())
+					{
+						shuffle.push_back(v);
+						break;
+					}
+				}
+			}
+
+			// A fixed seed of an engine of the search keeps runs reproducible
+			// without touching the rand() state of the process
+			using namespace std::placeholders;
+			std::mt19937 random(SHUFFLE_SEED);
+			std::shuffle(shuffle.begin(), shuffle.end(), random);
+			if (partitions_ > 1)
+			{
+				size_t now = 0;
+				for (size_t i = partition_; i < shuffle.size(); i += partitions_)
+				{
+					shuffle[now++] = shuffle[i];
+				}
+
+				shuffle.resize(now);
+			}
+
+			uint64_t fingerprint = Fingerprint(shuffle);
+			seedDone_.clear();
+			if (!checkpointFileName_.empty())
+			{
+				Checkpoint checkpoint;
+				seedDone_.assign((storage_.GetVerticesNumber() * 2 + 62) / 64, 0);
+				if (resume_ && checkpoint.Load(checkpointFileName_))
+				{
+					if (checkpoint.fingerprint != fingerprint)
+					{
+						throw std::runtime_error("The checkpoint was made by a run with other input or parameters");
+					}
+
+					RestoreCheckpoint(checkpoint);
+					if (verbose_)
+					{
+						std::cout << "Resuming with " << blocksFound_ << " blocks found" << std::endl;
+					}
+				}
+			}
+
+			if (report_ != 0)
+			{
+				uint64_t positions = storage_.GetPositionsNumber();
+				report_->SetArray("block_assignment", positions, positions * sizeof(Assignment));
+				report_->SetArray("seeds", shuffle.size(), shuffle.size() * sizeof(shuffle[0]));
+			}
+
+			seeding.reset();
+			RunReport::Phase search(report_, "search", threads);
+			SearchCounters::Reset();
+			seedsSkipped_ = 0;
+			runsPruned_ = 0;
+			prunedLength_ = 0;
+			StartProgress(shuffle.size());
+			std::mutex saverMutex;
+			std::condition_variable saverWake;
+			bool searchDone = false;
+			std::thread saver;
+			auto stopSaver = [&]()
+			{
+				if (saver.joinable())
+				{
+					{
+						std::lock_guard<std::mutex> lock(saverMutex);
+						searchDone = true;
+					}
+
+					saverWake.notify_one();
+					saver.join();
+				}
+			};
+
+			try
+			{
+				if (!checkpointFileName_.empty() && checkpointInterval_ > 0)
+				{
+					saver = std::thread([&]()
+					{
+						std::unique_lock<std::mutex> lock(saverMutex);
+						while (!saverWake.wait_for(lock, std::chrono::seconds(checkpointInterval_), [&]() { return searchDone; }))
+						{
+							SaveCheckpoint(fingerprint);
+						}
+					});
+				}
+
+
+				tbb::task_scheduler_init init(static_cast<int>(threads));
+				if (numa_ != 0 && numa_->GetNodesNumber() > 1)
+				{
+					FindBlocksPerNode(shuffle, threads);
+				}
+				else
+				{
+					tbb::parallel_for(tbb::blocked_range<size_t>(0, shuffle.size()), ProcessVertex(*this, shuffle));
+				}
+			}
+			catch (...)
+			{
+				// The reporter and the saver are stopped so that a server can
+				// search again and the unwinding doesn't end in terminate
+				stopSaver();
+				progress_.Stop(true);
+				throw;
+			}
+
+			stopSaver();
+			progress_.Stop();
+			if (regions_ != 0)
+			{
+				DropBlocksOutsideRegions();
+			}
+
+			for (size_t node = 0; node < nodeReport_.size(); node++)
+			{
+				if (verbose_)
+				{
+					std::cout << "Node " << node << ": " << nodeReport_[node].first << " seeds in " << nodeReport_[node].second << " s (" <<
+						nodeReport_[node].first / max(nodeReport_[node].second, 1e-3) << " seeds/s)" << std::endl;
+				}
+			}
+
+			if (pruning_ && verbose_)
+			{
+				std::cout << "Seeds skipped: " << seedsSkipped_ << ", runs pruned: " << runsPruned_ << ", extension bp pruned: " << prunedLength_ << std::endl;
+			}
+#ifdef SIBELIAZ_COUNTERS
+			SearchCounters::Values counters = SearchCounters::Collect();
+			for (size_t i = 0; i < SearchCounters::COUNTERS_NUMBER; i++)
+			{
+				if (verbose_)
+				{
+					std::cout << SearchCounters::Name(i) << ": " << counters.value[i] << std::endl;
+				}
+
+				if (report_ != 0)
+				{
+					report_->SetCounter(SearchCounters::Name(i), counters.value[i]);
+				}
+			}
+#endif
+		}
+
+		
+		// Blocks are taken in windows of consecutive ids and aligned under the
+		// memory budget of the scheduler. Each worker formats its record and
+		// passes it to the writer, which puts them in the order of ids. Blocks
+		// that cannot be aligned are left as <id>.fa in failedDir, as the
+		// sibeliaz script did, and listed with the reason in reportFile.
+		void ListBlocksAlignments(const std::string & fileName, const std::string & failedDir, const std::string & reportFile) const
+		{
+			std::ofstream report;
+			MafWriter maf(fileName, compressMaf_);
+			uint64_t ordinal = 0;
+			size_t skipped = 0;
+			size_t failed = 0;
+			int64_t threads = alignThreads_ > 0 ? alignThreads_ : threads_;
+			size_t window = size_t(threads) * ALIGNMENT_WINDOW_PER_THREAD;
+			AlignmentScheduler scheduler(size_t(threads), alignMemory_);
+			ForEachBucket(OUTPUT_BUCKET_SIZE, [&](const BlockList & bucket, const std::vector<IndexPair> & group)
+			{
+				for (size_t low = 0; low < group.size();)
+				{
+					uint64_t windowLength = 0;
+					std::vector<uint64_t> estimate;
+					std::vector<std::vector<std::vector<uint64_t> > > anchor;
+					for (size_t i = low; i < group.size() && i - low < window && windowLength < ALIGNMENT_WINDOW_LENGTH; i++)
+					{
+						uint64_t maxLength = 0;
+						uint64_t totalLength = 0;
+						for (size_t j = group[i].first; j < group[i].second; j++)
+						{
+							totalLength += bucket[j].GetLength();
+							maxLength = max(maxLength, uint64_t(bucket[j].GetLength()));
+						}
+
+						windowLength += totalLength;
+						anchor.push_back(std::vector<std::vector<uint64_t> >());
+						if (anchorLength_ > 0 && maxLength >= anchorLength_)
+						{
+							FindAnchors(bucket.begin() + group[i].first, bucket.begin() + group[i].second, anchor.back());
+						}
+
+						estimate.push_back(anchor.back().empty() ? AlignmentScheduler::EstimateMemory(maxLength, totalLength) : EstimateAnchoredMemory(bucket.begin() + group[i].first, anchor.back(), size_t(threads)));
+					}
+
+					size_t high = low + estimate.size();
+					std::vector<bool> admitted;
+					std::vector<char> failedJob;
+					std::vector<char> aligned(estimate.size(), 0);
+					scheduler.Run(estimate, admitted, failedJob, [&](size_t job)
+					{
+						BlockAligner aligner;
+						std::vector<std::string> row;
+						const IndexPair & block = group[low + job];
+						std::vector<std::string> sequence(block.second - block.first);
+						for (size_t j = 0; j < sequence.size(); j++)
+						{
+							CopyInstanceSequence(bucket[block.first + j], sequence[j]);
+						}
+
+						if (anchor[job].empty())
+						{
+							aligned[job] = aligner.Align(sequence, row);
+						}
+						else
+						{
+							aligned[job] = BlockAligner::AlignAnchored(sequence, anchor[job], k_, scheduler.GetArena(), row);
+						}
+
+						std::string record;
+						if (aligned[job])
+						{
+							FormatMafBlock(bucket.begin() + block.first, row, record);
+						}
+
+						std::string data = maf.Encode(record);
+						maf.Submit(ordinal + job, bucket[block.first].GetBlockId(), data, record.size());
+					});
+
+					for (size_t i = low; i < high; i++)
+					{
+						if (!admitted[i - low] || failedJob[i - low])
+						{
+							aligned[i - low] = 0;
+							std::string empty;
+							maf.Submit(ordinal + i - low, bucket[group[i].first].GetBlockId(), empty, 0);
+						}
+
+						if (!aligned[i - low])
+						{
+							if (skipped + failed == 0)
+							{
+								CreateOutDirectory(failedDir);
+								TryOpenFile(reportFile, report);
+							}
+
+							report << bucket[group[i].first].GetBlockId() << '\t';
+							if (admitted[i - low])
+							{
+								failed++;
+								report << (failedJob[i - low] ? "alignment failed with an error" : "alignment failed") << std::endl;
+							}
+							else
+							{
+								skipped++;
+								report << "estimated " << (estimate[i - low] >> 20) << " MB exceeds the memory budget of " << (alignMemory_ >> 20) << " MB" << std::endl;
+							}
+
+							std::string reverse;
+							std::ofstream out;
+							std::stringstream ss;
+							ss << failedDir << "/" << bucket[group[i].first].GetBlockId() << ".fa";
+							TryOpenFile(ss.str(), out);
+							OutputBuffer failedBuffer(out);
+							OutputBlockSequences(bucket.begin() + group[i].first, bucket.begin() + group[i].second, failedBuffer, reverse);
+							failedBuffer.Flush();
+						}
+					}
+
+					low = high;
+					ordinal += estimate.size();
+				}
+			});
+
+			maf.Close();
+			if (skipped + failed > 0)
+			{
+				std::cout << "Blocks not aligned: " << skipped + failed << " (" << skipped << " over the memory budget), see " << reportFile << std::endl;
+			}
+		}
+
+		// Blocks of a bucket are formatted in parallel. Without bundles every block
+		// goes to its own <id>.fa, otherwise block id % bundles_ picks one of the
+		// shared blocks_<shard>.fa files and blocks.idx records where each block is.
+		void ListBlocksSequences(const std::string & directory) const
+		{
+			std::ofstream index;
+			std::vector<uint64_t> shardSize(bundles_, 0);
+			std::vector<std::unique_ptr<std::ofstream> > shard(bundles_);
+			for (size_t i = 0; i < bundles_; i++)
+			{
+				shard[i].reset(new std::ofstream);
+				TryOpenFile(directory + "/" + BundleName(i), *shard[i]);
+			}
+
+			if (bundles_ > 0)
+			{
+				TryOpenFile(directory + "/blocks.idx", index);
+			}
+
+			OutputBuffer indexBuffer(index);
+			tbb::task_arena arena(static_cast<int>(threads_));
+			ForEachBucket(OUTPUT_BUCKET_SIZE, [&](const BlockList & bucket, const std::vector<IndexPair> & group)
+			{
+				std::vector<std::vector<BundleEntry> > entry(bundles_);
+				arena.execute([&]()
+				{
+					if (bundles_ == 0)
+					{
+						tbb::parallel_for(tbb::blocked_range<size_t>(0, group.size()), [&](const tbb::blocked_range<size_t> & range)
+						{
+							std::string reverse;
+							for (size_t i = range.begin(); i != range.end(); i++)
+							{
+								std::ofstream out;
+								std::stringstream ss;
+								ss << directory << "/" << bucket[group[i].first].GetBlockId() << ".fa";
+								TryOpenFile(ss.str(), out);
+								OutputBuffer buffer(out);
+								OutputBlockSequences(bucket.begin() + group[i].first, bucket.begin() + group[i].second, buffer, reverse);
+								buffer.Flush();
+							}
+						});
+					}
+					else
+					{
+						tbb::parallel_for(size_t(0), bundles_, [&](size_t now)
+						{
+							std::string reverse;
+							OutputBuffer buffer(*shard[now]);
+							for (const IndexPair & block : group)
+							{
+								size_t id = bucket[block.first].GetBlockId();
+								if (id % bundles_ == now)
+								{
+									uint64_t start = buffer.GetWritten();
+									OutputBlockSequences(bucket.begin() + block.first, bucket.begin() + block.second, buffer, reverse);
+									entry[now].push_back(BundleEntry(id, now, shardSize[now] + start, buffer.GetWritten() - start));
+								}
+							}
+
+							buffer.Flush();
+							shardSize[now] += buffer.GetWritten();
+						});
+					}
+				});
+
+				std::vector<BundleEntry> all;
+				for (auto & list : entry)
+				{
+					all.insert(all.end(), list.begin(), list.end());
+				}
+
+				std::sort(all.begin(), all.end());
+				for (auto & e : all)
+				{
+					indexBuffer << uint64_t(e.id) << '\t' << BundleName(e.shard) << '\t' << e.offset << '\t' << e.length << '\n';
+				}
+			});
+
+			indexBuffer.Flush();
+		}
+
+		// Instances are written while blockId_ is scanned, without being collected.
+		// Sorting by block id is done a bucket of ids at a time.
+		void GenerateOutput(const std::string & outDir, bool genSeq, bool sortById = true) const
+		{
+			CreateOutDirectory(outDir);
+			std::string blocksDir = outDir + "/blocks";
+			size_t totalLength = 0;
+			{
+				RunReport::Phase phase(report_, "output_gff");
+				totalLength = ListBlocksIndicesGFF(outDir + "/" + "blocks_coords.gff", sortById);
+			}
+
+			size_t totalSize = 0;
+			for (int64_t i = 0; i < storage_.GetChrNumber(); i++)
+			{
+				totalSize += storage_.GetChrSequence(i).size();
+			}
+
+			std::cout.setf(std::cout.fixed);
+			std::cout.precision(2);
+			std::cout << "Blocks found: " << blocksFound_ << std::endl;
+			std::cout << "Total coverage: " << double(totalLength) / totalSize << std::endl;
+			if (genSeq)
+			{
+				RunReport::Phase phase(report_, "output_sequences", threads_);
+				CreateOutDirectory(blocksDir);
+				ListBlocksSequences(blocksDir);
+			}
+
+			if (align_)
+			{
+				RunReport::Phase phase(report_, "alignment", alignThreads_ > 0 ? alignThreads_ : threads_);
+				ListBlocksAlignments(outDir + (compressMaf_ ? "/alignment.maf.gz" : "/alignment.maf"), blocksDir, outDir + "/unaligned.txt");
+			}
+		}
+
+		template<class F>
+		void ForEachInstance(F f) const
+		{
+			for (size_t chr = 0; chr < blockId_.size(); chr++)
+			{
+				for (size_t i = 0; i < blockId_[chr].size();)
+				{
+					if (blockId_[chr][i].block != 0)
+					{
+						int64_t bid = blockId_[chr][i].block;
+						size_t j = i;
+						for (; j < blockId_[chr].size() && blockId_[chr][i] == blockId_[chr][j]; j++);
+						j--;
+						int64_t start = storage_.GetIterator(chr, i, bid > 0).GetPosition() + (bid > 0 ? 0 : -k_);
+						int64_t end = storage_.GetIterator(chr, j, bid > 0).GetPosition() + (bid > 0 ? k_ : 0);
+						f(BlockInstance(int(bid), chr, size_t(start), size_t(end)));
+						i = j + 1;
+					}
+					else
+					{
+						++i;
+					}
+				}
+			}
+		}
+
+		template<class F>
+		void ForEachBlock(size_t maxInstances, F f) const
+		{
+			ForEachBucket(maxInstances, [&f](const BlockList & bucket, const std::vector<IndexPair> & group)
+			{
+				for (const IndexPair & block : group)
+				{
+					f(bucket.begin() + block.first, bucket.begin() + block.second);
+				}
+			});
+		}
+
+		// Calls f(bucket, group) with the instances of a range of consecutive block
+		// ids sorted by id, and the [first, second) bounds of each block in it.
+		// Buckets hold at most maxInstances instances (unless a single block is
+		// larger) and each costs one scan of blockId_.
+		template<class F>
+		void ForEachBucket(size_t maxInstances, F f) const
+		{
+			std::vector<size_t> count;
+			ForEachInstance([&count](const BlockInstance & instance)
+			{
+				if (size_t(instance.GetBlockId()) >= count.size())
+				{
+					count.resize(instance.GetBlockId() + 1, 0);
+				}
+
+				count[instance.GetBlockId()]++;
+			});
+
+			BlockList bucket;
+			std::vector<IndexPair> group;
+			for (size_t low = 1; low < count.size();)
+			{
+				size_t high = low;
+				for (size_t size = 0; high < count.size() && (high == low || size + count[high] <= maxInstances); size += count[high++]);
+				bucket.clear();
+				ForEachInstance([&bucket, low, high](const BlockInstance & instance)
+				{
+					if (size_t(instance.GetBlockId()) >= low && size_t(instance.GetBlockId()) < high)
+					{
+						bucket.push_back(instance);
+					}
+				});
+
+				group.clear();
+				std::stable_sort(bucket.begin(), bucket.end(), compareById);
+				for (size_t now = 0; now < bucket.size();)
+				{
+					size_t prev = now;
+					for (; now < bucket.size() && bucket[now].GetBlockId() == bucket[prev].GetBlockId(); now++);
+					group.push_back(IndexPair(prev, now));
+				}
+
+				f(static_cast<const BlockList&>(bucket), static_cast<const std::vector<IndexPair>&>(group));
+				low = high;
+			}
+		}
+
+	private:
+		// Times the private steps of the search, see lcbbench.cpp
+		friend class BlocksFinderBenchmark;
+
+		void InitSearch(int64_t minBlockSize, int64_t maxBranchSize, int64_t maxFlankingSize, int64_t lookingDepth, int64_t sampleSize, int64_t threads)
+		{
+			blocksFound_ = 0;
+			threads_ = threads;
+			sampleSize_ = sampleSize;
+			lookingDepth_ = lookingDepth;
+			minBlockSize_ = minBlockSize;
+			maxBranchSize_ = maxBranchSize;
+			maxFlankingSize_ = maxFlankingSize;
+			blockId_.resize(storage_.GetChrNumber());
+			for (int64_t i = 0; i < storage_.GetChrNumber(); i++)
+			{
+				blockId_[i].assign(storage_.GetChrVerticesCount(i), Assignment());
+			}
+		}
+
+		struct BundleEntry
+		{
+			size_t id;
+			size_t shard;
+			uint64_t offset;
+			uint64_t length;
+
+			BundleEntry(size_t id, size_t shard, uint64_t offset, uint64_t length) : id(id), shard(shard), offset(offset), length(length)
+			{
+
+			}
+
+			bool operator < (const BundleEntry & entry) const
+			{
+				return id < entry.id;
+			}
+		};
+
+		static std::string BundleName(size_t shard)
+		{
+			std::stringstream ss;
+			ss << "blocks_" << shard << ".fa";
+			return ss.str();
+		}
+
+		void OutputLines(const char * start, size_t length, OutputBuffer & out) const
+		{
+			for (size_t i = 0; i < length; i += 80)
+			{
+				if (i > 0)
+				{
+					out.Put('\n');
+				}
+
+				out.Write(start + i, min(size_t(80), length - i));
+			}
+		}
+
+		size_t JunctionIndex(size_t chr, int64_t pos) const
+		{
+			size_t low = 0;
+			size_t high = storage_.GetChrVerticesCount(chr);
+			while (low < high)
+			{
+				size_t mid = low + (high - low) / 2;
+				if (storage_.GetIterator(chr, mid).GetAbsolutePosition() < pos)
+				{
+					low = mid + 1;
+				}
+				else
+				{
+					high = mid;
+				}
+			}
+
+			return low;
+		}
+
+		// Anchors are junctions met exactly once in every copy of the block, in
+		// the same order and without overlaps along all of them. anchor[a][c] is
+		// the offset of the k-mer of anchor a in copy c as the copy is written.
+		void FindAnchors(BlockList::const_iterator begin, BlockList::const_iterator end, std::vector<std::vector<uint64_t> > & anchor) const
+		{
+			const int64_t NONE = -1;
+			const int64_t REPEATED = -2;
+			size_t copies = end - begin;
+			std::vector<std::pair<int64_t, int64_t> > order;
+			std::unordered_map<int64_t, std::vector<int64_t> > offset;
+			for (size_t c = 0; c < copies; c++)
+			{
+				const BlockInstance & instance = *(begin + c);
+				bool positive = instance.GetSignedBlockId() > 0;
+				size_t chr = instance.GetChrId();
+				size_t last = JunctionIndex(chr, int64_t(instance.GetEnd() - k_));
+				for (size_t idx = JunctionIndex(chr, int64_t(instance.GetStart())); idx <= last; idx++)
+				{
+					JunctionStorage::JunctionSequentialIterator it = storage_.GetIterator(chr, idx, positive);
+					int64_t now = positive ? it.GetAbsolutePosition() - instance.GetStart() : instance.GetEnd() - (it.GetAbsolutePosition() + k_);
+					if (c == 0)
+					{
+						order.push_back(std::make_pair(now, it.GetVertexId()));
+						offset.insert(std::make_pair(it.GetVertexId(), std::vector<int64_t>(copies, NONE)));
+					}
+
+					auto jt = offset.find(it.GetVertexId());
+					if (jt != offset.end())
+					{
+						jt->second[c] = jt->second[c] == NONE ? now : REPEATED;
+					}
+				}
+			}
+
+			std::sort(order.begin(), order.end());
+			std::vector<int64_t> prev(copies, -int64_t(k_));
+			for (auto & vertex : order)
+			{
+				const std::vector<int64_t> & now = offset[vertex.second];
+				bool ok = true;
+				for (size_t c = 0; c < copies && ok; c++)
+				{
+					ok = now[c] >= prev[c] + int64_t(k_);
+				}
+
+				if (ok)
+				{
+					prev = now;
+					anchor.push_back(std::vector<uint64_t>(now.begin(), now.end()));
+				}
+			}
+		}
+
+		// Segments of a block are aligned by up to threads threads at once
+		uint64_t EstimateAnchoredMemory(BlockList::const_iterator begin, const std::vector<std::vector<uint64_t> > & anchor, size_t threads) const
+		{
+			uint64_t ret = 0;
+			size_t copies = anchor[0].size();
+			for (size_t s = 0; s <= anchor.size(); s++)
+			{
+				uint64_t maxLength = 0;
+				uint64_t totalLength = 0;
+				for (size_t c = 0; c < copies; c++)
+				{
+					uint64_t start = s == 0 ? 0 : anchor[s - 1][c] + k_;
+					uint64_t end = s == anchor.size() ? (begin + c)->GetLength() : anchor[s][c];
+					totalLength += end - start;
+					maxLength = max(maxLength, end - start);
+				}
+
+				ret = max(ret, AlignmentScheduler::EstimateMemory(maxLength, totalLength));
+			}
+
+			return ret * min(threads, anchor.size() + 1);
+		}
+
+		void CopyInstanceSequence(const BlockInstance & instance, std::string & buf) const
+		{
+			const std::string & sequence = storage_.GetChrSequence(instance.GetChrId());
+			if (instance.GetSignedBlockId() > 0)
+			{
+				buf.assign(sequence.begin() + instance.GetStart(), sequence.begin() + instance.GetEnd());
+			}
+			else
+			{
+				buf.assign(sequence.rbegin() + (sequence.size() - instance.GetEnd()), sequence.rbegin() + (sequence.size() - instance.GetStart()));
+				std::transform(buf.begin(), buf.end(), buf.begin(), TwoPaCo::DnaChar::ReverseChar);
+			}
+		}
+
+		void FormatMafBlock(BlockList::const_iterator begin, const std::vector<std::string> & row, std::string & record) const
+		{
+			record = "\na\n";
+			for (size_t i = 0; i < row.size(); i++)
+			{
+				const BlockInstance & instance = *(begin + i);
+				size_t chr = instance.GetChrId();
+				uint64_t chrSize = storage_.GetChrSequence(chr).size();
+				bool positive = instance.GetSignedBlockId() > 0;
+				record += "s " + storage_.GetChrDescription(chr) + ' ' + std::to_string(positive ? instance.GetStart() : chrSize - instance.GetEnd());
+				record += ' ' + std::to_string(instance.GetLength()) + ' ' + (positive ? '+' : '-') + ' ' + std::to_string(chrSize) + ' ' + row[i] + '\n';
+			}
+		}
+
+		// Negative copies are reverse-complemented into reverse as a whole before
+		// being written
+		void OutputBlockSequences(BlockList::const_iterator begin, BlockList::const_iterator end, OutputBuffer & buffer, std::string & reverse) const
+		{
+			for (auto it = begin; it != end; ++it)
+			{
+				uint64_t length = it->GetLength();
+				size_t chr = it->GetChrId();
+				const std::string & sequence = storage_.GetChrSequence(chr);
+				uint64_t chrSize = sequence.size();
+				buffer << '>' << uint64_t(it->GetBlockId()) << '_' << uint64_t(it - begin) << ' ';
+				buffer << storage_.GetChrDescription(chr) << ';';
+				if (it->GetSignedBlockId() > 0)
+				{
+					buffer << uint64_t(it->GetStart()) << ';' << length << ";+;" << chrSize << '\n';
+					OutputLines(sequence.data() + it->GetStart(), length, buffer);
+				}
+				else
+				{
+					buffer << uint64_t(chrSize - it->GetEnd()) << ';' << length << ";-;" << chrSize << '\n';
+					CopyInstanceSequence(*it, reverse);
+					OutputLines(reverse.data(), length, buffer);
+				}
+
+				buffer << '\n';
+			}
+		}
+
+		double CalculateCoverage(const BlockList & block) const;
+		void GenerateReport(const BlockList & block, const std::string & fileName) const;
+		void CalculateCoverage(GroupedBlockList::const_iterator start, GroupedBlockList::const_iterator end, std::vector<double> & ret) const;
+		std::string OutputIndex(const BlockInstance & block) const;
+		void OutputBlocks(const std::vector<BlockInstance>& block, std::ofstream& out) const;
+		void ListBlocksIndices(const BlockList & block, const std::string & fileName) const;
+		size_t ListBlocksIndicesGFF(const std::string & fileName, bool sortById) const;
+		void ListChromosomesAsPermutations(const BlockList & block, const std::string & fileName) const;
+		void TryOpenFile(const std::string & fileName, std::ofstream & stream) const;
+		void ListChrs(std::ostream & out) const;
+
+		template<class T>
+		void DumpVertex(int64_t id, std::ostream & out, T & visit, int64_t cnt = 5) const
+		{
+			for (auto kt = JunctionStorage::JunctionIterator(id); kt.Valid(); ++kt)
+			{
+				auto jt = kt.SequentialIterator();
+				for (int64_t i = 0; i < cnt; i++)
+				{
+					auto it = jt - 1;
+					auto pr = std::make_pair(it, jt);
+					if (it.Valid() && std::find(visit.begin(), visit.end(), pr) == visit.end())
+					{
+						int64_t length = it.GetPosition() - jt.GetPosition();
+						out << it.GetVertexId() << " -> " << jt.GetVertexId()
+							<< "[label=\"" << it.GetChar() << ", " << it.GetChrId() << ", " << it.GetPosition() << "," << length << "\""
+							<< (it.IsPositiveStrand() ? "color=blue" : "color=red") << "]\n";
+						visit.push_back(pr);
+					}
+
+					jt = it;
+				}
+			}
+
+			for (auto kt = JunctionStorage::JunctionIterator(id); kt.Valid(); ++kt)
+			{
+				auto it = kt.SequentialIterator();
+				for (int64_t i = 0; i < cnt; i++)
+				{
+					auto jt = it + 1;
+					auto pr = std::make_pair(it, jt);
+					if (jt.Valid() && std::find(visit.begin(), visit.end(), pr) == visit.end())
+					{
+						int64_t length = it.GetPosition() - jt.GetPosition();
+						out << it.GetVertexId() << " -> " << jt.GetVertexId()
+							<< "[label=\"" << it.GetChar() << ", " << it.GetChrId() << ", " << it.GetPosition() << "," << length << "\""
+							<< (it.IsPositiveStrand() ? "color=blue" : "color=red") << "]\n";
+						visit.push_back(pr);
+					}
+
+					it = jt;
+				}
+			}
+		}
+
+		// Each seed is sent to the node holding most of its occurrences, and every
+		// node works through its own seeds in an arena pinned to its CPUs. The
+		// threads are spread evenly over the nodes, the first ones taking the
+		// remainder; the seeds of a node left without threads go to another.
+		void FindBlocksPerNode(std::vector<int64_t> & shuffle, int64_t threads)
+		{
+			size_t nodes = numa_->GetNodesNumber();
+			threads = max(threads, int64_t(1));
+			std::vector<int64_t> share(nodes);
+			for (size_t node = 0; node < nodes; node++)
+			{
+				share[node] = threads / int64_t(nodes) + (int64_t(node) < threads % int64_t(nodes) ? 1 : 0);
+			}
+
+			std::vector<size_t> vote(nodes);
+			std::vector<std::vector<int64_t> > local(nodes);
+			for (int64_t vid : shuffle)
+			{
+				vote.assign(nodes, 0);
+				for (JunctionStorage::JunctionIterator it(vid); it.Valid(); ++it)
+				{
+					vote[storage_.GetChrNode(it.GetChrId())]++;
+				}
+
+				size_t node = std::max_element(vote.begin(), vote.end()) - vote.begin();
+				local[share[node] > 0 ? node : node % size_t(threads)].push_back(vid);
+			}
+
+			std::vector<size_t> bound(1, 0);
+			shuffle.clear();
+			for (auto & seed : local)
+			{
+				shuffle.insert(shuffle.end(), seed.begin(), seed.end());
+				bound.push_back(shuffle.size());
+			}
+
+			nodeReport_.assign(nodes, std::make_pair(size_t(0), 0.0));
+			numa_->RunOnEachNode([&](size_t node)
+			{
+				if (share[node] == 0)
+				{
+					return;
+				}
+
+				auto start = std::chrono::steady_clock::now();
+				tbb::task_arena arena(static_cast<int>(share[node]));
+				NumaTopology::Pinner pinner(arena, *numa_, node);
+				arena.execute([&]()
+				{
+					tbb::parallel_for(tbb::blocked_range<size_t>(bound[node], bound[node + 1]), ProcessVertex(*this, shuffle));
+				});
+
+				nodeReport_[node].first = bound[node + 1] - bound[node];
+				nodeReport_[node].second = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			});
+		}
+
+		bool HasFreeInstances(int64_t vid) const
+		{
+			size_t free = 0;
+			for (JunctionStorage::JunctionIterator it(vid); it.Valid() && free < 2; ++it)
+			{
+				free += it.IsUsed() ? 0 : 1;
+			}
+
+			return free >= 2;
+		}
+
+		// A run is abandoned once no score reachable within its remaining length
+		// budget can be positive. The budget is the rest of minRun plus one branch
+		// of overshoot, which is a heuristic: a single long edge can exceed it.
+		bool PruneRun(const Path & currentPath, bool forward, int64_t runLength, int64_t minRun)
+		{
+			if (pruning_)
+			{
+				int64_t remain = max(int64_t(0), minRun - runLength);
+				if (currentPath.ScoreUpperBound(remain + maxBranchSize_, forward) <= 0)
+				{
+					runsPruned_++;
+					prunedLength_ += remain;
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		// Another process may have taken some of the positions since the path was
+		// built. Then the claims made here are rolled back and the seed is dropped.
+		bool ClaimInstances(const Path & finalizer)
+		{
+			if (!storage_.HasUsedMap())
+			{
+				return true;
+			}
+
+			std::vector<JunctionStorage::JunctionSequentialIterator> claimed;
+			for (auto jt : finalizer.AllInstances())
+			{
+				if (finalizer.IsGoodInstance(*jt))
+				{
+					auto it = jt->Front();
+					do
+					{
+						if (it.Claim())
+						{
+							claimed.push_back(it);
+						}
+						else if (!it.IsUsedLocally())
+						{
+							for (auto & kt : claimed)
+							{
+								kt.Release();
+							}
+
+							return false;
+						}
+					} while (it++ != jt->Back());
+				}
+			}
+
+			return true;
+		}
+
+		// An instance may jump over used junctions, which must not take the
+		// restored blocks of a saved run apart
+		bool SparesBaseline(const Path & finalizer) const
+		{
+			if (baseline_ == 0)
+			{
+				return true;
+			}
+
+			for (auto jt : finalizer.AllInstances())
+			{
+				if (finalizer.IsGoodInstance(*jt))
+				{
+					auto it = jt->Front();
+					do
+					{
+						int32_t block = blockId_[it.GetChrId()][it.GetIndex()].block;
+						if (block != 0 && abs(block) <= baseline_->blocksFound)
+						{
+							return false;
+						}
+					} while (it++ != jt->Back());
+				}
+			}
+
+			return true;
+		}
+
+		bool TryFinalizeBlock(const Path & currentPath, Path & finalizer, size_t bestRightSize, size_t bestLeftSize)
+		{
+			bool ret = false;
+			tbb::spin_rw_mutex::scoped_lock state;
+			if (!seedDone_.empty())
+			{
+				state.acquire(stateMutex_, false);
+			}
+
+			std::vector<Path::InstanceSet::const_iterator> lockInstance;
+			for (auto it : currentPath.GoodInstancesList())
+			{
+				lockInstance.push_back(it);
+			}
+			
+			std::sort(lockInstance.begin(), lockInstance.end(), Path::CmpInstance);
+			{
+				std::pair<size_t, size_t> idx(SIZE_MAX, SIZE_MAX);
+				for (auto & instance : lockInstance)
+				{
+					if (instance->Front().IsPositiveStrand())
+					{
+						storage_.LockRange(instance->Front(), instance->Back(), idx);
+					}
+					else
+					{
+						storage_.LockRange(instance->Back().Reverse(), instance->Front().Reverse(), idx);
+					}
+				}
+			}
+		
+			finalizer.Init(currentPath.Origin());
+			for (size_t i = 0; i < bestRightSize - 1 && finalizer.PointPushBack(currentPath.RightPoint(i).GetEdge()); i++);
+			for (size_t i = 0; i < bestLeftSize - 1 && finalizer.PointPushFront(currentPath.LeftPoint(i).GetEdge()); i++);
+			SIBELIAZ_COUNT(FINALIZE_ATTEMPTS, 1);
+			if (finalizer.Score() > 0 && finalizer.GoodInstances() > 1 && SparesBaseline(finalizer) && ClaimInstances(finalizer))
+			{
+				SIBELIAZ_COUNT(FINALIZE_SUCCESSES, 1);
+				ret = true;
+				int64_t instanceCount = 0;
+				int64_t currentBlock = ++blocksFound_;	
+				uint64_t positions = 0;
+				uint64_t bp = 0;
+				for (auto jt : finalizer.AllInstances())
+				{
+					if (finalizer.IsGoodInstance(*jt))
+					{
+						auto it = jt->Front();
+						bp += abs(jt->Back().GetPosition() - jt->Front().GetPosition()) + k_;
+						do
+						{
+							it.MarkUsed();							
+							int64_t idx = it.GetIndex();
+							int64_t maxidx = storage_.GetChrVerticesCount(it.GetChrId());
+							positions += blockId_[it.GetChrId()][it.GetIndex()].block == 0 ? 1 : 0;
+							blockId_[it.GetChrId()][it.GetIndex()].block = int32_t(it.IsPositiveStrand() ? +currentBlock : -currentBlock);
+							blockId_[it.GetChrId()][it.GetIndex()].instance = int32_t(instanceCount);
+
+						} while (it++ != jt->Back());
+
+						instanceCount++;
+					}
+				}
+
+				progress_.BlockFound(positions, bp);
+			}
 				
 			finalizer.Clear();
 			std::pair<size_t, size_t> idx(SIZE_MAX, SIZE_MAX);
@@ -636,6 +1837,7 @@ namespace Sibelia
 					auto it = forward ? origin.Next() : origin.Prev();
 					for (size_t d = 1; it.Valid() && (d < size_t(lookingDepth_)  || abs(it.GetPosition() - origin.GetPosition()) <= maxBranchSize_); d++)
 					{
+						SIBELIAZ_COUNT(LOOKAHEAD_SCANNED, 1);
 						int64_t vid = it.GetVertexId();
 						if (!currentPath.IsInPath(vid) && !it.IsUsed())
 						{
@@ -782,19 +1984,42 @@ namespace Sibelia
 		}
 
 		int64_t k_;
-		size_t progressCount_;
-		size_t progressPortion_;
-		std::atomic<int64_t> count_;
 		std::atomic<int64_t> blocksFound_;
+		std::atomic<int64_t> seedsSkipped_;
+		std::atomic<int64_t> runsPruned_;
+		std::atomic<int64_t> prunedLength_;
 		int64_t sampleSize_;
 		int64_t scalingFactor_;
+		bool pruning_;
+		size_t bundles_;
+		int64_t threads_;
+		bool align_;
+		int64_t alignThreads_;
+		uint64_t alignMemory_;
+		uint64_t anchorLength_;
+		bool compressMaf_;
+		size_t partition_;
+		size_t partitions_;
 		bool scoreFullChains_;
 		int64_t lookingDepth_;
 		int64_t minBlockSize_;
 		int64_t maxBranchSize_;
 		int64_t maxFlankingSize_;
 		JunctionStorage & storage_;
-		tbb::mutex progressMutex_;
+		const NumaTopology * numa_;
+		const LcbIndex * baseline_;
+		const RegionSet * regions_;
+		RunReport * report_;
+		std::string checkpointFileName_;
+		size_t checkpointInterval_;
+		bool resume_;
+		std::string statusFileName_;
+		size_t statusInterval_;
+		bool verbose_;
+		ProgressTracker progress_;
+		std::vector<uint64_t> seedDone_;
+		tbb::spin_rw_mutex stateMutex_;
+		std::vector<std::pair<size_t, double> > nodeReport_;
 		std::ofstream debugOut_;
 		std::vector<std::vector<Edge> > syntenyPath_;
 		std::vector<std::vector<Assignment> > blockId_;
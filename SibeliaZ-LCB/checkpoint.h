@@ -0,0 +1,209 @@
+#ifndef _CHECKPOINT_H_
+#define _CHECKPOINT_H_
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "binaryio.h"
+#include "junctioncodec.h"
+
+namespace Sibelia
+{
+	// A snapshot of a running search: the seeds already processed, the number
+	// of blocks found and, per chromosome, the used bits and the block and
+	// instance of every position. The file is the "SZCK" magic, a version, the
+	// fingerprint of the run, the number of blocks, the seed bitmap and the
+	// chromosomes, whose assignment is coded as zigzag varints since most
+	// positions are free or repeat their neighbour. The "SZCE" magic ends it.
+	// The assignment is kept coded in memory as well.
+	class Checkpoint
+	{
+	public:
+		static const uint32_t VERSION = 1;
+		// The three lengths a chromosome takes at least and the two varints of
+		// a position
+		static const uint64_t CHROMOSOME_BYTES = 3 * sizeof(uint64_t);
+		static const uint64_t POSITION_BYTES = 2;
+
+		struct Chromosome
+		{
+			std::vector<uint64_t> used;
+			uint64_t positions;
+			std::vector<uint8_t> code;
+			Chromosome() : positions(0)
+			{
+
+			}
+		};
+
+		// Appends the block and instance of the next position of a chromosome
+		class Encoder
+		{
+		public:
+			Encoder(Chromosome & chr) : chr_(chr), block_(0), instance_(0)
+			{
+
+			}
+
+			void Encode(int32_t block, int32_t instance)
+			{
+				uint8_t buf[20];
+				uint8_t * end = PutVarint(Zigzag(int64_t(block) - block_), buf);
+				end = PutVarint(Zigzag(int64_t(instance) - instance_), end);
+				chr_.code.insert(chr_.code.end(), buf, end);
+				chr_.positions++;
+				block_ = block;
+				instance_ = instance;
+			}
+
+		private:
+			Chromosome & chr_;
+			int32_t block_;
+			int32_t instance_;
+		};
+
+		class Decoder
+		{
+		public:
+			Decoder(const Chromosome & chr) : it_(chr.code.data()), end_(chr.code.data() + chr.code.size()), block_(0), instance_(0)
+			{
+
+			}
+
+			// Returns false if the code ends before the position does
+			bool Decode(int32_t & block, int32_t & instance)
+			{
+				uint64_t value;
+				if (!Next(value))
+				{
+					return false;
+				}
+
+				block = block_ = int32_t(block_ + Unzigzag(value));
+				if (!Next(value))
+				{
+					return false;
+				}
+
+				instance = instance_ = int32_t(instance_ + Unzigzag(value));
+				return true;
+			}
+
+			bool AtEnd() const
+			{
+				return it_ == end_;
+			}
+
+		private:
+			bool Next(uint64_t & value)
+			{
+				value = 0;
+				for (size_t shift = 0; it_ < end_ && shift < 64; shift += 7)
+				{
+					uint8_t byte = *it_++;
+					value |= uint64_t(byte & 0x7f) << shift;
+					if ((byte & 0x80) == 0)
+					{
+						return true;
+					}
+				}
+
+				return false;
+			}
+
+			const uint8_t * it_;
+			const uint8_t * end_;
+			int32_t block_;
+			int32_t instance_;
+		};
+
+		uint64_t fingerprint;
+		int64_t blocksFound;
+		std::vector<uint64_t> seed;
+		std::vector<Chromosome> chr;
+
+		// The file is written aside and renamed over fileName, so a crash while
+		// saving leaves the previous checkpoint intact
+		void Save(const std::string & fileName) const
+		{
+			std::string tmpFileName = fileName + ".tmp";
+			{
+				std::ofstream out(tmpFileName.c_str(), std::ios::binary);
+				out.write("SZCK", 4);
+				WriteBinary(out, VERSION);
+				WriteBinary(out, fingerprint);
+				WriteBinary(out, blocksFound);
+				WriteBinaryVector(out, seed);
+				WriteBinary(out, uint64_t(chr.size()));
+				for (const Chromosome & now : chr)
+				{
+					WriteBinaryVector(out, now.used);
+					WriteBinary(out, now.positions);
+					WriteBinaryVector(out, now.code);
+				}
+
+				out.write("SZCE", 4);
+				out.flush();
+				if (!out)
+				{
+					throw std::runtime_error(("Cannot write the checkpoint " + tmpFileName).c_str());
+				}
+			}
+
+			if (std::rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+			{
+				throw std::runtime_error(("Cannot replace the checkpoint " + fileName).c_str());
+			}
+		}
+
+		// Returns false if there is no checkpoint yet
+		bool Load(const std::string & fileName)
+		{
+			std::ifstream in(fileName.c_str(), std::ios::binary);
+			if (!in)
+			{
+				return false;
+			}
+
+			char magic[4];
+			if (!in.read(magic, sizeof(magic)) || memcmp(magic, "SZCK", sizeof(magic)) != 0 || ReadBinary<uint32_t>(in) != VERSION)
+			{
+				throw std::runtime_error(("Can't read the checkpoint " + fileName).c_str());
+			}
+
+			fingerprint = ReadBinary<uint64_t>(in);
+			blocksFound = ReadBinary<int64_t>(in);
+			ReadBinaryVector(in, seed);
+			chr.resize(ReadBinaryLength(in, CHROMOSOME_BYTES));
+			for (Chromosome & now : chr)
+			{
+				ReadBinaryVector(in, now.used);
+				now.positions = ReadBinaryLength(in, POSITION_BYTES);
+				ReadBinaryVector(in, now.code);
+				uint64_t count = 0;
+				int32_t block;
+				int32_t instance;
+				Decoder decoder(now);
+				for (; count < now.positions && decoder.Decode(block, instance); count++);
+				if (in && (count != now.positions || !decoder.AtEnd()))
+				{
+					throw std::runtime_error(("The checkpoint " + fileName + " is corrupted").c_str());
+				}
+			}
+
+			if (!in.read(magic, sizeof(magic)) || memcmp(magic, "SZCE", sizeof(magic)) != 0)
+			{
+				throw std::runtime_error(("The checkpoint " + fileName + " is truncated").c_str());
+			}
+
+			return true;
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,284 @@
+#ifndef _COMPACT_JUNCTIONS_H_
+#define _COMPACT_JUNCTIONS_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include <zlib.h>
+#include <sys/stat.h>
+
+#include <junctionapi.h>
+
+#include "junctioncodec.h"
+
+namespace Sibelia
+{
+	// A compact alternative to the TwoPaCo junction file. After the "SZJC"
+	// magic and a version come blocks of at most BLOCK_JUNCTIONS junctions of
+	// one chromosome. A block is the tag 'B', chr, count, the sizes of the two
+	// columns and the CRC32 of the payload (all 32-bit little-endian), then the
+	// zigzag varint position deltas and the zigzag varint ids. The tag 'I'
+	// starts the index: the number of blocks and the offset, chr and count of
+	// each. The file ends with the offset of the index and the "SZJX" magic, so
+	// the blocks can be located and decoded independently.
+	class CompactJunctionFormat
+	{
+	public:
+		static const uint32_t VERSION = 1;
+		static const size_t BLOCK_JUNCTIONS = size_t(1) << 20;
+		static const size_t HEADER_BYTES = 8;
+		static const size_t BLOCK_HEADER_BYTES = 21;
+		static const size_t FOOTER_BYTES = 12;
+
+		struct Block
+		{
+			uint64_t offset;
+			uint32_t chr;
+			uint32_t count;
+		};
+
+		// Only regular files are probed, so a pipe is never consumed
+		static bool IsCompact(const std::string & fileName)
+		{
+			struct stat st;
+			if (stat(fileName.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+			{
+				return false;
+			}
+
+			char magic[4];
+			std::ifstream in(fileName.c_str(), std::ios::binary);
+			return in.read(magic, sizeof(magic)) && memcmp(magic, "SZJC", sizeof(magic)) == 0;
+		}
+
+		static void ReadIndex(std::ifstream & in, std::vector<Block> & block)
+		{
+			uint8_t footer[FOOTER_BYTES];
+			in.seekg(-int64_t(FOOTER_BYTES), std::ios::end);
+			if (!in.read(reinterpret_cast<char*>(footer), FOOTER_BYTES) || memcmp(footer + 8, "SZJX", 4) != 0)
+			{
+				throw std::runtime_error("The compact junction file has no index");
+			}
+
+			uint8_t head[9];
+			in.seekg(Load(footer, 8));
+			if (!in.read(reinterpret_cast<char*>(head), sizeof(head)) || head[0] != 'I')
+			{
+				throw std::runtime_error("The compact junction index is corrupted");
+			}
+
+			std::vector<uint8_t> entry(Load(head + 1, 8) * 16);
+			if (!entry.empty() && !in.read(reinterpret_cast<char*>(&entry[0]), entry.size()))
+			{
+				throw std::runtime_error("The compact junction index is corrupted");
+			}
+
+			block.resize(entry.size() / 16);
+			for (size_t i = 0; i < block.size(); i++)
+			{
+				block[i].offset = Load(&entry[i * 16], 8);
+				block[i].chr = uint32_t(Load(&entry[i * 16 + 8], 4));
+				block[i].count = uint32_t(Load(&entry[i * 16 + 12], 4));
+			}
+		}
+
+		// Reads the block starting at the current position of in. Returns false
+		// when the index is reached instead.
+		static bool ReadBlock(std::istream & in, std::vector<uint8_t> & payload, std::vector<TwoPaCo::JunctionPosition> & junction)
+		{
+			uint8_t head[BLOCK_HEADER_BYTES];
+			if (!in.read(reinterpret_cast<char*>(head), 1) || head[0] == 'I')
+			{
+				return false;
+			}
+
+			if (head[0] != 'B' || !in.read(reinterpret_cast<char*>(head + 1), BLOCK_HEADER_BYTES - 1))
+			{
+				throw std::runtime_error("The compact junction file is corrupted");
+			}
+
+			uint32_t chr = uint32_t(Load(head + 1, 4));
+			uint32_t count = uint32_t(Load(head + 5, 4));
+			uint64_t posBytes = Load(head + 9, 4);
+			uint64_t idBytes = Load(head + 13, 4);
+			payload.resize(posBytes + idBytes + 1);
+			if (!in.read(reinterpret_cast<char*>(&payload[0]), posBytes + idBytes) ||
+				uint32_t(crc32(crc32(0, Z_NULL, 0), &payload[0], uInt(posBytes + idBytes))) != uint32_t(Load(head + 17, 4)))
+			{
+				throw std::runtime_error("A block of the compact junction file is corrupted");
+			}
+
+			int64_t pos = 0;
+			uint64_t value = 0;
+			const uint8_t * posIt = &payload[0];
+			const uint8_t * idIt = posIt + posBytes;
+			junction.resize(count);
+			for (uint32_t i = 0; i < count; i++)
+			{
+				posIt = GetVarint(posIt, value);
+				pos += Unzigzag(value);
+				idIt = GetVarint(idIt, value);
+				junction[i] = TwoPaCo::JunctionPosition(chr, uint32_t(pos), Unzigzag(value));
+			}
+
+			if (posIt != &payload[0] + posBytes || idIt != posIt + idBytes)
+			{
+				throw std::runtime_error("A block of the compact junction file is corrupted");
+			}
+
+			return true;
+		}
+
+		static uint64_t Load(const uint8_t * data, size_t bytes)
+		{
+			uint64_t ret = 0;
+			for (size_t i = 0; i < bytes; i++)
+			{
+				ret |= uint64_t(data[i]) << (8 * i);
+			}
+
+			return ret;
+		}
+
+		static void Store(uint64_t value, size_t bytes, std::ostream & out)
+		{
+			for (size_t i = 0; i < bytes; i++, value >>= 8)
+			{
+				out.put(char(value & 0xff));
+			}
+		}
+	};
+
+	// Reads a compact junction file sequentially, like TwoPaCo's reader
+	class CompactJunctionReader
+	{
+	public:
+		CompactJunctionReader(const std::string & fileName) : in_(fileName.c_str(), std::ios::binary), next_(0)
+		{
+			char magic[CompactJunctionFormat::HEADER_BYTES];
+			if (!in_.read(magic, sizeof(magic)) || memcmp(magic, "SZJC", 4) != 0)
+			{
+				throw std::runtime_error(("Can't read the compact junction file " + fileName).c_str());
+			}
+
+			if (CompactJunctionFormat::Load(reinterpret_cast<uint8_t*>(magic + 4), 4) != CompactJunctionFormat::VERSION)
+			{
+				throw std::runtime_error(("Unsupported version of the compact junction file " + fileName).c_str());
+			}
+		}
+
+		bool NextJunctionPosition(TwoPaCo::JunctionPosition & junction)
+		{
+			while (next_ == junction_.size())
+			{
+				next_ = 0;
+				if (!CompactJunctionFormat::ReadBlock(in_, payload_, junction_))
+				{
+					junction_.clear();
+					return false;
+				}
+			}
+
+			junction = junction_[next_++];
+			return true;
+		}
+
+	private:
+		std::ifstream in_;
+		size_t next_;
+		std::vector<uint8_t> payload_;
+		std::vector<TwoPaCo::JunctionPosition> junction_;
+	};
+
+	class CompactJunctionWriter
+	{
+	public:
+		CompactJunctionWriter(const std::string & fileName) : out_(fileName.c_str(), std::ios::binary), chr_(0), prevPos_(0), count_(0)
+		{
+			if (!out_)
+			{
+				throw std::runtime_error(("Can't create the file " + fileName).c_str());
+			}
+
+			out_.write("SZJC", 4);
+			CompactJunctionFormat::Store(CompactJunctionFormat::VERSION, 4, out_);
+		}
+
+		void WriteJunction(const TwoPaCo::JunctionPosition & junction)
+		{
+			if (count_ > 0 && (junction.GetChr() != chr_ || count_ == CompactJunctionFormat::BLOCK_JUNCTIONS))
+			{
+				FlushBlock();
+			}
+
+			uint8_t buf[10];
+			chr_ = junction.GetChr();
+			pos_.insert(pos_.end(), buf, PutVarint(Zigzag(int64_t(junction.GetPos()) - prevPos_), buf));
+			id_.insert(id_.end(), buf, PutVarint(Zigzag(junction.GetId()), buf));
+			prevPos_ = junction.GetPos();
+			count_++;
+		}
+
+		void Close()
+		{
+			if (count_ > 0)
+			{
+				FlushBlock();
+			}
+
+			uint64_t indexOffset = uint64_t(out_.tellp());
+			out_.put('I');
+			CompactJunctionFormat::Store(block_.size(), 8, out_);
+			for (auto & block : block_)
+			{
+				CompactJunctionFormat::Store(block.offset, 8, out_);
+				CompactJunctionFormat::Store(block.chr, 4, out_);
+				CompactJunctionFormat::Store(block.count, 4, out_);
+			}
+
+			CompactJunctionFormat::Store(indexOffset, 8, out_);
+			out_.write("SZJX", 4);
+			out_.flush();
+			if (!out_)
+			{
+				throw std::runtime_error("Cannot write the compact junction file");
+			}
+		}
+
+	private:
+		void FlushBlock()
+		{
+			CompactJunctionFormat::Block block;
+			block.offset = uint64_t(out_.tellp());
+			block.chr = chr_;
+			block.count = uint32_t(count_);
+			block_.push_back(block);
+			pos_.insert(pos_.end(), id_.begin(), id_.end());
+			out_.put('B');
+			CompactJunctionFormat::Store(chr_, 4, out_);
+			CompactJunctionFormat::Store(count_, 4, out_);
+			CompactJunctionFormat::Store(pos_.size() - id_.size(), 4, out_);
+			CompactJunctionFormat::Store(id_.size(), 4, out_);
+			CompactJunctionFormat::Store(crc32(crc32(0, Z_NULL, 0), pos_.data(), uInt(pos_.size())), 4, out_);
+			out_.write(reinterpret_cast<const char*>(pos_.data()), pos_.size());
+			pos_.clear();
+			id_.clear();
+			prevPos_ = 0;
+			count_ = 0;
+		}
+
+		std::ofstream out_;
+		uint32_t chr_;
+		int64_t prevPos_;
+		size_t count_;
+		std::vector<uint8_t> pos_;
+		std::vector<uint8_t> id_;
+		std::vector<CompactJunctionFormat::Block> block_;
+	};
+}
+
+#endif
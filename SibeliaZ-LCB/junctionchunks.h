@@ -0,0 +1,97 @@
+#ifndef _JUNCTION_CHUNKS_H_
+#define _JUNCTION_CHUNKS_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+
+#include <sys/stat.h>
+
+#include <junctionapi.h>
+
+#include "compactjunctions.h"
+
+namespace Sibelia
+{
+	// Splits a junction file into chunks that can be decoded independently:
+	// the blocks of a compact file, or runs of records of a TwoPaCo file,
+	// whose records are a 32-bit chromosome, a 32-bit position and a 64-bit id
+	class JunctionFileChunks
+	{
+	public:
+		static const uint64_t TWOPACO_RECORD_BYTES = 16;
+		static const uint64_t TWOPACO_CHUNK_RECORDS = uint64_t(1) << 20;
+
+		JunctionFileChunks(const std::string & fileName) : fileName_(fileName), compact_(CompactJunctionFormat::IsCompact(fileName))
+		{
+			if (compact_)
+			{
+				std::ifstream in(fileName.c_str(), std::ios::binary);
+				CompactJunctionFormat::ReadIndex(in, block_);
+			}
+			else
+			{
+				struct stat st;
+				if (stat(fileName.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size % TWOPACO_RECORD_BYTES == 0)
+				{
+					uint64_t records = st.st_size / TWOPACO_RECORD_BYTES;
+					for (uint64_t start = 0; start < records; start += TWOPACO_CHUNK_RECORDS)
+					{
+						CompactJunctionFormat::Block block;
+						block.offset = start * TWOPACO_RECORD_BYTES;
+						block.chr = 0;
+						block.count = uint32_t(std::min(uint64_t(TWOPACO_CHUNK_RECORDS), records - start));
+						block_.push_back(block);
+					}
+				}
+			}
+		}
+
+		// False if the file can only be read sequentially, e.g. it is a pipe
+		bool IsSplittable() const
+		{
+			return compact_ || !block_.empty();
+		}
+
+		size_t GetChunksNumber() const
+		{
+			return block_.size();
+		}
+
+		void Decode(size_t chunk, std::vector<TwoPaCo::JunctionPosition> & junction) const
+		{
+			std::ifstream in(fileName_.c_str(), std::ios::binary);
+			in.seekg(block_[chunk].offset);
+			if (compact_)
+			{
+				std::vector<uint8_t> payload;
+				CompactJunctionFormat::ReadBlock(in, payload, junction);
+			}
+			else
+			{
+				std::vector<uint8_t> record(block_[chunk].count * TWOPACO_RECORD_BYTES);
+				if (!in.read(reinterpret_cast<char*>(record.data()), record.size()))
+				{
+					throw std::runtime_error(("Can't read the junction file " + fileName_).c_str());
+				}
+
+				junction.resize(block_[chunk].count);
+				for (size_t i = 0; i < junction.size(); i++)
+				{
+					const uint8_t * now = &record[i * TWOPACO_RECORD_BYTES];
+					junction[i] = TwoPaCo::JunctionPosition(uint32_t(CompactJunctionFormat::Load(now, 4)),
+						uint32_t(CompactJunctionFormat::Load(now + 4, 4)),
+						int64_t(CompactJunctionFormat::Load(now + 8, 8)));
+				}
+			}
+		}
+
+	private:
+		std::string fileName_;
+		bool compact_;
+		std::vector<CompactJunctionFormat::Block> block_;
+	};
+}
+
+#endif
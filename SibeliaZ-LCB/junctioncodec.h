@@ -0,0 +1,112 @@
+#ifndef _JUNCTION_CODEC_H_
+#define _JUNCTION_CODEC_H_
+
+#include <cstdint>
+
+#include <junctionapi.h>
+
+namespace Sibelia
+{
+	inline uint64_t Zigzag(int64_t value)
+	{
+		return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+	}
+
+	inline int64_t Unzigzag(uint64_t value)
+	{
+		return int64_t(value >> 1) ^ -int64_t(value & 1);
+	}
+
+	inline uint8_t * PutVarint(uint64_t value, uint8_t * out)
+	{
+		for (; value >= 0x80; value >>= 7)
+		{
+			*out++ = uint8_t(value | 0x80);
+		}
+
+		*out++ = uint8_t(value);
+		return out;
+	}
+
+	inline const uint8_t * GetVarint(const uint8_t * in, uint64_t & value)
+	{
+		value = 0;
+		for (size_t shift = 0; ; shift += 7)
+		{
+			uint8_t byte = *in++;
+			value |= uint64_t(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0)
+			{
+				return in;
+			}
+		}
+	}
+
+	// Junctions come sorted by chromosome and position, so each one is coded as
+	// varints of the chromosome delta, the zigzagged position delta within the
+	// chromosome and the zigzagged vertex id. That is 4-7 bytes instead of 16.
+	class JunctionEncoder
+	{
+	public:
+		static const size_t MAX_BYTES = 25;
+
+		JunctionEncoder() : chr_(0), pos_(0)
+		{
+
+		}
+
+		// Writes at most MAX_BYTES bytes to out, returns the end of the record
+		uint8_t * Encode(const TwoPaCo::JunctionPosition & junction, uint8_t * out)
+		{
+			uint64_t chr = junction.GetChr();
+			if (chr != chr_)
+			{
+				pos_ = 0;
+			}
+
+			out = PutVarint(chr - chr_, out);
+			out = PutVarint(Zigzag(int64_t(junction.GetPos()) - pos_), out);
+			out = PutVarint(Zigzag(junction.GetId()), out);
+			chr_ = chr;
+			pos_ = junction.GetPos();
+			return out;
+		}
+
+	private:
+		uint64_t chr_;
+		int64_t pos_;
+	};
+
+	class JunctionDecoder
+	{
+	public:
+		JunctionDecoder() : chr_(0), pos_(0)
+		{
+
+		}
+
+		// Reads one record starting at in, returns the start of the next one
+		const uint8_t * Decode(const uint8_t * in, TwoPaCo::JunctionPosition & junction)
+		{
+			uint64_t value;
+			in = GetVarint(in, value);
+			if (value > 0)
+			{
+				chr_ += value;
+				pos_ = 0;
+			}
+
+			in = GetVarint(in, value);
+			pos_ += Unzigzag(value);
+			in = GetVarint(in, value);
+			junction = TwoPaCo::JunctionPosition(uint32_t(chr_), uint32_t(pos_), Unzigzag(value));
+			return in;
+		}
+
+	private:
+		uint64_t chr_;
+		int64_t pos_;
+	};
+}
+
+#endif
@@ -0,0 +1,57 @@
+#include <string>
+#include <iostream>
+#include <stdexcept>
+
+#include <tclap/CmdLine.h>
+
+#include "blocksfinder.h"
+#include "compactjunctions.h"
+
+int main(int argc, char * argv[])
+{
+	try
+	{
+		TCLAP::CmdLine cmd("Converts a TwoPaCo junction file to the compact junction format", ' ', Sibelia::VERSION);
+
+		TCLAP::ValueArg<std::string> inFileName("i",
+			"input",
+			"TwoPaCo junction file",
+			true,
+			"",
+			"file name",
+			cmd);
+
+		TCLAP::ValueArg<std::string> outFileName("o",
+			"output",
+			"Compact junction file",
+			true,
+			"",
+			"file name",
+			cmd);
+
+		cmd.parse(argc, argv);
+
+		uint64_t junctions = 0;
+		TwoPaCo::JunctionPositionReader reader(inFileName.getValue());
+		Sibelia::CompactJunctionWriter writer(outFileName.getValue());
+		for (TwoPaCo::JunctionPosition junction; reader.NextJunctionPosition(junction); junctions++)
+		{
+			writer.WriteJunction(junction);
+		}
+
+		writer.Close();
+		std::cout << "Junctions converted: " << junctions << std::endl;
+	}
+	catch (TCLAP::ArgException & e)
+	{
+		std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+	catch (std::runtime_error & e)
+	{
+		std::cerr << "error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -6,15 +6,32 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <chrono>
+#include <functional>
 #include <cstdint>
+#include <iostream>
 #include <stdexcept>
 #include <algorithm>
+#include <unordered_map>
 
 #include <tbb/mutex.h>
+#include <tbb/task_arena.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 
 #include <streamfastaparser.h>
 #include <junctionapi.h>
 
+#include "usedmap.h"
+#include "junctioncodec.h"
+#include "lcbindex.h"
+#include "junctionchunks.h"
+#include "kmerjunctions.h"
+#include "compactjunctions.h"
+#include "numatopology.h"
+#include "runreport.h"
+#include "searchcounters.h"
+
 namespace Sibelia
 {	
 	using std::min;
@@ -271,8 +288,7 @@ namespace Sibelia
 
 			bool IsUsed() const
 			{
-				bool ret = JunctionStorage::this_->position_[GetChrId()][idx_].used;
-				return ret;
+				return JunctionStorage::this_->IsUsedPosition(GetChrId(), idx_);
 			}
 
 			void MarkUsed() const
@@ -280,6 +296,21 @@ namespace Sibelia
 				JunctionStorage::this_->position_[GetChrId()][idx_].used = true;
 			}
 
+			bool IsUsedLocally() const
+			{
+				return JunctionStorage::this_->position_[GetChrId()][idx_].used;
+			}
+
+			bool Claim() const
+			{
+				return JunctionStorage::this_->usedMap_ == 0 || JunctionStorage::this_->usedMap_->Claim(JunctionStorage::this_->chrOffset_[GetChrId()] + idx_);
+			}
+
+			void Release() const
+			{
+				JunctionStorage::this_->usedMap_->Release(JunctionStorage::this_->chrOffset_[GetChrId()] + idx_);
+			}
+
 			JunctionSequentialIterator& operator++ ()
 			{
 				Inc();
@@ -448,7 +479,7 @@ namespace Sibelia
 
 			bool IsUsed() const
 			{
-				return JunctionStorage::this_->position_[GetChrId()][GetIndex()].used;
+				return JunctionStorage::this_->IsUsedPosition(GetChrId(), GetIndex());
 			}
 
 			void MarkUsed() const
@@ -510,6 +541,328 @@ namespace Sibelia
 
 		};
 
+		// Both TwoPaCo's junction files and compact ones are accepted
+		template<class F>
+		static void ReadJunctions(const std::string & fileName, F & f)
+		{
+			if (CompactJunctionFormat::IsCompact(fileName))
+			{
+				CompactJunctionReader reader(fileName);
+				for (TwoPaCo::JunctionPosition junction; reader.NextJunctionPosition(junction);)
+				{
+					f(junction);
+				}
+			}
+			else
+			{
+				TwoPaCo::JunctionPositionReader reader(fileName);
+				for (TwoPaCo::JunctionPosition junction; reader.NextJunctionPosition(junction);)
+				{
+					f(junction);
+				}
+			}
+		}
+
+		// Junction sources are passed over three times while the storage is built
+		class FileJunctionSource
+		{
+		public:
+			FileJunctionSource(const std::string & fileName) : fileName_(fileName)
+			{
+
+			}
+
+			template<class F>
+			void ForEach(F f) const
+			{
+				ReadJunctions(fileName_, f);
+			}
+
+		private:
+			std::string fileName_;
+		};
+
+		// Keeps a junction stream delta coded in fixed chunks, so buffering it
+		// costs a few bytes per junction and never reallocates what is stored.
+		// Every chunk starts a new code, so chunks decode independently.
+		class MemoryJunctionSource
+		{
+		public:
+			static const size_t CHUNK_SIZE = size_t(1) << 24;
+
+			MemoryJunctionSource() : size_(0)
+			{
+
+			}
+
+			void Add(const TwoPaCo::JunctionPosition & junction)
+			{
+				if (chunk_.empty() || chunk_.back().size() + JunctionEncoder::MAX_BYTES > CHUNK_SIZE)
+				{
+					encoder_ = JunctionEncoder();
+					chunk_.push_back(std::vector<uint8_t>());
+					chunk_.back().reserve(CHUNK_SIZE);
+				}
+
+				uint8_t record[JunctionEncoder::MAX_BYTES];
+				std::vector<uint8_t> & now = chunk_.back();
+				now.insert(now.end(), record, encoder_.Encode(junction, record));
+				size_++;
+			}
+
+			size_t GetSize() const
+			{
+				return size_;
+			}
+
+			uint64_t GetBytes() const
+			{
+				uint64_t ret = 0;
+				for (auto & now : chunk_)
+				{
+					ret += now.size();
+				}
+
+				return ret;
+			}
+
+			template<class F>
+			void ForEach(F f) const
+			{
+				std::vector<TwoPaCo::JunctionPosition> junction;
+				for (size_t i = 0; i < chunk_.size(); i++)
+				{
+					Decode(i, junction);
+					for (auto & now : junction)
+					{
+						f(now);
+					}
+				}
+			}
+
+			size_t GetChunksNumber() const
+			{
+				return chunk_.size();
+			}
+
+			void Decode(size_t chunk, std::vector<TwoPaCo::JunctionPosition> & junction) const
+			{
+				JunctionDecoder decoder;
+				junction.clear();
+				const std::vector<uint8_t> & now = chunk_[chunk];
+				for (const uint8_t * it = now.data(); it < now.data() + now.size();)
+				{
+					junction.push_back(TwoPaCo::JunctionPosition());
+					it = decoder.Decode(it, junction.back());
+				}
+			}
+
+		private:
+			size_t size_;
+			JunctionEncoder encoder_;
+			std::vector<std::vector<uint8_t> > chunk_;
+		};
+
+		// Returns the abundance threshold with the repeat vertices kept
+		int64_t KeepRepeats(int64_t abundanceThreshold)
+		{
+			repeatThreshold_ = repeatAbundance_ > abundanceThreshold ? size_t(abundanceThreshold) : SIZE_MAX;
+			return max(abundanceThreshold, repeatAbundance_);
+		}
+
+		template<class Source>
+		void BuildPositions(const Source & source, int64_t abundanceThreshold, int64_t loopThreshold)
+		{
+			abundanceThreshold = KeepRepeats(abundanceThreshold);
+			std::vector<size_t> abundance;
+			source.ForEach([&](const TwoPaCo::JunctionPosition & junction)
+			{
+				if (junction.GetChr() >= chrSize_.size())
+				{
+					chrSize_.push_back(0);
+				}
+
+				size_t absId = abs(junction.GetId());
+				while (absId >= vertex_.size())
+				{
+					vertex_.push_back(VertexVector());
+					abundance.push_back(0);
+				}
+
+				++abundance[absId];
+			});
+
+			{
+				Buffer buffer(loopThreshold);
+				source.ForEach([&](const TwoPaCo::JunctionPosition & junction)
+				{
+					size_t absId = abs(junction.GetId());
+					if (abundance[absId] < size_t(abundanceThreshold) && buffer.AddAndCheck(junction))
+					{
+						++chrSize_[junction.GetChr()];
+					}
+				});
+			}
+
+			position_.resize(chrSize_.size());
+			for (size_t i = 0; i < chrSize_.size(); i++)
+			{
+				position_[i].reset(new Position[chrSize_[i]]);
+			}
+
+			{
+				uint32_t idx = 0;
+				size_t chr = 0;
+				Buffer buffer(loopThreshold);
+				source.ForEach([&](const TwoPaCo::JunctionPosition & junction)
+				{
+					if (junction.GetChr() > chr)
+					{
+						chr = junction.GetChr();
+						idx = 0;
+					}
+
+					size_t absId = abs(junction.GetId());
+					if (abundance[absId] < size_t(abundanceThreshold) && buffer.AddAndCheck(junction))
+					{
+						position_[junction.GetChr()][idx].Assign(junction);
+						vertex_[absId].push_back(Vertex(junction));
+						vertex_[absId].back().idx = idx++;
+					}
+				});
+			}
+		}
+
+		// The same as BuildPositions with every pass decoding the chunks of the
+		// source on TBB workers. Buffer::AddAndCheck accepts every junction, so
+		// only the abundance filter is applied. Kept junctions get their indices
+		// from per-chromosome prefix sums over the chunks, and the vertex lists
+		// are filled by a scan of position_ to keep the order of the file.
+		template<class Source>
+		void BuildPositionsParallel(const Source & source, int64_t threads, int64_t abundanceThreshold)
+		{
+			abundanceThreshold = KeepRepeats(abundanceThreshold);
+			size_t chunks = source.GetChunksNumber();
+			if (chunks == 0)
+			{
+				return;
+			}
+
+			tbb::task_arena arena(static_cast<int>(threads));
+			std::vector<size_t> chunkMaxId(chunks, 0);
+			std::vector<size_t> chunkMaxChr(chunks, 0);
+			std::vector<std::vector<std::pair<size_t, size_t> > > chunkKept(chunks);
+			auto forEachChunk = [&](std::function<void(size_t, const std::vector<TwoPaCo::JunctionPosition> &)> f)
+			{
+				arena.execute([&]()
+				{
+					tbb::parallel_for(tbb::blocked_range<size_t>(0, chunks, 1), [&](const tbb::blocked_range<size_t> & range)
+					{
+						std::vector<TwoPaCo::JunctionPosition> junction;
+						for (size_t chunk = range.begin(); chunk != range.end(); chunk++)
+						{
+							source.Decode(chunk, junction);
+							f(chunk, junction);
+						}
+					});
+				});
+			};
+
+			forEachChunk([&](size_t chunk, const std::vector<TwoPaCo::JunctionPosition> & junction)
+			{
+				for (auto & now : junction)
+				{
+					chunkMaxId[chunk] = max(chunkMaxId[chunk], size_t(abs(now.GetId())));
+					chunkMaxChr[chunk] = max(chunkMaxChr[chunk], size_t(now.GetChr()));
+				}
+			});
+
+			std::vector<std::atomic<uint32_t> > abundance(*std::max_element(chunkMaxId.begin(), chunkMaxId.end()) + 1);
+			forEachChunk([&](size_t, const std::vector<TwoPaCo::JunctionPosition> & junction)
+			{
+				for (auto & now : junction)
+				{
+					abundance[abs(now.GetId())].fetch_add(1, std::memory_order_relaxed);
+				}
+			});
+
+			forEachChunk([&](size_t chunk, const std::vector<TwoPaCo::JunctionPosition> & junction)
+			{
+				for (auto & now : junction)
+				{
+					if (chunkKept[chunk].empty() || chunkKept[chunk].back().first != now.GetChr())
+					{
+						chunkKept[chunk].push_back(std::make_pair(size_t(now.GetChr()), size_t(0)));
+					}
+
+					if (abundance[abs(now.GetId())] < size_t(abundanceThreshold))
+					{
+						chunkKept[chunk].back().second++;
+					}
+				}
+			});
+
+			std::vector<std::vector<size_t> > chunkStart(chunks);
+			chrSize_.assign(max(chrSize_.size(), *std::max_element(chunkMaxChr.begin(), chunkMaxChr.end()) + 1), 0);
+			for (size_t chunk = 0; chunk < chunks; chunk++)
+			{
+				for (auto & kept : chunkKept[chunk])
+				{
+					chunkStart[chunk].push_back(chrSize_[kept.first]);
+					chrSize_[kept.first] += kept.second;
+				}
+			}
+
+			position_.resize(chrSize_.size());
+			for (size_t i = 0; i < chrSize_.size(); i++)
+			{
+				position_[i].reset(new Position[chrSize_[i]]);
+			}
+
+			forEachChunk([&](size_t chunk, const std::vector<TwoPaCo::JunctionPosition> & junction)
+			{
+				if (junction.empty())
+				{
+					return;
+				}
+
+				size_t run = 0;
+				size_t idx = chunkStart[chunk][0];
+				for (size_t i = 0; i < junction.size(); i++)
+				{
+					if (i > 0 && junction[i].GetChr() != junction[i - 1].GetChr())
+					{
+						idx = chunkStart[chunk][++run];
+					}
+
+					if (abundance[abs(junction[i].GetId())] < size_t(abundanceThreshold))
+					{
+						position_[junction[i].GetChr()][idx++].Assign(junction[i]);
+					}
+				}
+			});
+
+			vertex_.resize(abundance.size());
+			for (size_t i = 0; i < vertex_.size(); i++)
+			{
+				if (abundance[i] < size_t(abundanceThreshold))
+				{
+					vertex_[i].reserve(abundance[i]);
+				}
+			}
+
+			for (size_t chr = 0; chr < chrSize_.size(); chr++)
+			{
+				for (size_t idx = 0; idx < chrSize_[chr]; idx++)
+				{
+					const Position & now = position_[chr][idx];
+					size_t absId = abs(now.id);
+					vertex_[absId].push_back(Vertex(TwoPaCo::JunctionPosition(uint32_t(chr), now.pos, now.id)));
+					vertex_[absId].back().idx = uint32_t(idx);
+				}
+			}
+		}
+
 		class Buffer
 		{
 		private:
@@ -548,7 +901,16 @@ namespace Sibelia
 				size_t idx = MutexIdx(start.GetChrId(), start.GetIndex());
 				if (start.GetChrId() != prevIdx.first || idx != prevIdx.second)
 				{
+#ifdef SIBELIAZ_COUNTERS
+					SIBELIAZ_COUNT(STRIPE_ACQUISITIONS, 1);
+					if (!mutex_[start.GetChrId()][idx].mutex.try_lock())
+					{
+						SIBELIAZ_COUNT(STRIPE_WAITS, 1);
+						mutex_[start.GetChrId()][idx].mutex.lock();
+					}
+#else
 					mutex_[start.GetChrId()][idx].mutex.lock();
+#endif
 					prevIdx.first = start.GetChrId();
 					prevIdx.second = idx;
 				}
@@ -593,6 +955,31 @@ namespace Sibelia
 			return chrSize_[chrId];
 		}
 
+		// The index of the first junction of the chromosome at pos or after it
+		size_t LowerBound(uint64_t chrId, uint64_t pos) const
+		{
+			const Position * begin = position_[chrId].get();
+			return std::lower_bound(begin, begin + chrSize_[chrId], pos, [](const Position & position, uint64_t pos) { return position.pos < pos; }) - begin;
+		}
+
+		// The occurrences of the vertex in the chromosome starting in [start, end]
+		// as a range of JunctionIterator indices. The occurrences of a vertex are
+		// kept in the order of chromosomes and positions, so this is O(log n).
+		std::pair<size_t, size_t> OccurrenceRange(int64_t vertexId, uint64_t chrId, uint64_t start, uint64_t end) const
+		{
+			const VertexVector & now = vertex_[abs(vertexId)];
+			auto less = [](const Vertex & vertex, const std::pair<uint64_t, uint64_t> & key) { return vertex.chr < key.first || (vertex.chr == key.first && vertex.pos < key.second); };
+			auto first = std::lower_bound(now.begin(), now.end(), std::make_pair(chrId, start), less);
+			auto last = std::lower_bound(first, now.end(), std::make_pair(chrId, end + 1), less);
+			return std::make_pair(size_t(first - now.begin()), size_t(last - now.begin()));
+		}
+
+		// A vertex kept only because of SetRepeatAbundance
+		bool IsRepeat(int64_t vertexId) const
+		{
+			return vertex_[abs(vertexId)].size() >= repeatThreshold_;
+		}
+
 		JunctionSequentialIterator GetIterator(uint64_t chrId, uint64_t idx, bool isPositiveStrand = true) const
 		{
 			return JunctionSequentialIterator(chrId, idx, isPositiveStrand);
@@ -747,89 +1134,256 @@ namespace Sibelia
 			return sequence_[idx];
 		}
 
-		void Init(const std::string & inFileName, const std::string & genomesFileName, int64_t threads, int64_t abundanceThreshold, int64_t loopThreshold)
+		// The genomes are read first, so with a stream the graph producer can
+		// still be running meanwhile. A stream is read only once, which allows
+		// inFileName to be a pipe or "-" for stdin, and kept in memory delta coded
+		// until the abundance filter can be applied.
+		void Init(const std::string & inFileName, const std::string & genomesFileName, int64_t threads, int64_t abundanceThreshold, int64_t loopThreshold, bool stream = false)
 		{
 			this_ = this;
-			std::vector<size_t> abundance;
 			{
-				TwoPaCo::JunctionPositionReader reader(inFileName);
-				for (TwoPaCo::JunctionPosition junction; reader.NextJunctionPosition(junction);)
+				RunReport::Phase phase(report_, "read_fasta");
+				for (TwoPaCo::StreamFastaParser parser(genomesFileName); parser.ReadRecord();)
 				{
-					if (junction.GetChr() >= chrSize_.size())
+					sequence_.push_back(std::string());
+					sequenceDescription_.push_back(parser.GetCurrentHeader());
+					sequenceId_[parser.GetCurrentHeader()] = sequenceDescription_.size() - 1;
+					for (char ch; parser.GetChar(ch); )
 					{
-						chrSize_.push_back(0);
+						sequence_.back().push_back(ch);
 					}
+				}
+			}
 
-					size_t absId = abs(junction.GetId());
-					while (absId >= vertex_.size())
+			if (stream)
+			{
+				MemoryJunctionSource source;
+				{
+					RunReport::Phase phase(report_, "read_junctions");
+					auto start = std::chrono::steady_clock::now();
+					auto add = [&source](const TwoPaCo::JunctionPosition & junction) { source.Add(junction); };
+					ReadJunctions(inFileName == "-" ? "/dev/stdin" : inFileName, add);
+
+					std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+					std::cout << "Graph streamed: " << source.GetSize() << " junctions in " << elapsed.count() << " s, buffered in " << (source.GetBytes() >> 20) << " MB" << std::endl;
+					if (report_ != 0)
 					{
-						vertex_.push_back(VertexVector());
-						abundance.push_back(0);
+						report_->SetArray("junction_buffer", source.GetSize(), source.GetBytes());
 					}
+				}
 
-					++abundance[absId];
+				RunReport::Phase phase(report_, "build_positions", threads);
+				if (threads > 1)
+				{
+					BuildPositionsParallel(source, threads, abundanceThreshold);
+				}
+				else
+				{
+					BuildPositions(source, abundanceThreshold, loopThreshold);
+				}
+			}
+			else
+			{
+				// Every pass of the build reads the file, so this is one phase
+				RunReport::Phase phase(report_, "read_junctions", threads);
+				JunctionFileChunks chunks(inFileName);
+				if (threads > 1 && chunks.IsSplittable())
+				{
+					BuildPositionsParallel(chunks, threads, abundanceThreshold);
+				}
+				else
+				{
+					BuildPositions(FileJunctionSource(inFileName), abundanceThreshold, loopThreshold);
 				}
 			}
 
+			FinishInit(threads);
+		}
+
+		// Builds the storage from the genomes alone, their junctions are found by
+		// KmerJunctionFinder instead of being read from a TwoPaCo graph
+		void InitFromGenomes(const std::string & genomesFileName, int64_t threads, int64_t abundanceThreshold)
+		{
+			std::vector<std::string> sequence;
+			std::vector<std::string> description;
 			{
-				Buffer buffer(loopThreshold);
-				TwoPaCo::JunctionPositionReader reader(inFileName);
-				for (TwoPaCo::JunctionPosition junction; reader.NextJunctionPosition(junction);)
+				RunReport::Phase phase(report_, "read_fasta");
+				for (TwoPaCo::StreamFastaParser parser(genomesFileName); parser.ReadRecord();)
 				{
-					size_t absId = abs(junction.GetId());
-					if (abundance[absId] < size_t(abundanceThreshold) && buffer.AddAndCheck(junction))
+					sequence.push_back(std::string());
+					description.push_back(parser.GetCurrentHeader());
+					for (char ch; parser.GetChar(ch); )
 					{
-						++chrSize_[junction.GetChr()];
+						sequence.back().push_back(ch);
 					}
 				}
 			}
 
-			position_.resize(chrSize_.size());
-			for (size_t i = 0; i < chrSize_.size(); i++)
+			MemoryJunctionSource source;
 			{
-				position_[i].reset(new Position[chrSize_[i]]);
+				RunReport::Phase phase(report_, "find_junctions", threads);
+				KmerJunctionFinder(k_).Find(sequence, threads, [&source](const TwoPaCo::JunctionPosition & junction) { source.Add(junction); });
+				if (report_ != 0)
+				{
+					report_->SetArray("junction_buffer", source.GetSize(), source.GetBytes());
+				}
 			}
 
+			Init(description, sequence, source, threads, abundanceThreshold);
+		}
+
+		// Builds the storage from genomes and junctions already in memory, the
+		// junctions ordered by chromosome and position as in a TwoPaCo file.
+		// The sequences are moved out of sequence.
+		void Init(const std::vector<std::string> & description, std::vector<std::string> & sequence, const MemoryJunctionSource & source, int64_t threads, int64_t abundanceThreshold)
+		{
+			this_ = this;
+			for (size_t i = 0; i < sequence.size(); i++)
 			{
-				uint32_t idx = 0;
-				size_t chr = 0;
-				Buffer buffer(loopThreshold);
-				TwoPaCo::JunctionPositionReader reader(inFileName);
-				for (TwoPaCo::JunctionPosition junction; reader.NextJunctionPosition(junction);)
+				sequence_.push_back(std::string());
+				sequence_.back().swap(sequence[i]);
+				sequenceDescription_.push_back(description[i]);
+				sequenceId_[description[i]] = i;
+			}
+
+			chrSize_.assign(sequence_.size(), 0);
+			{
+				RunReport::Phase phase(report_, "build_positions", threads);
+				if (threads > 1)
 				{
-					if (junction.GetChr() > chr)
+					BuildPositionsParallel(source, threads, abundanceThreshold);
+				}
+				else
+				{
+					BuildPositions(source, abundanceThreshold, 0);
+				}
+			}
+
+			FinishInit(threads);
+		}
+
+		// Builds the storage of a saved run with the genomes of newGenomesFileName
+		// added as new chromosomes. Their junctions are the occurrences of the
+		// k-mers of the saved vertices and, unless newGraphFileName is empty, the
+		// junctions TwoPaCo found in the new genomes alone, which get fresh ids.
+		// Junctions that only the new genomes would create in the old ones are
+		// not added. The sequences are moved out of the index.
+		void InitIncremental(LcbIndex & index, const std::string & newGenomesFileName, const std::string & newGraphFileName, int64_t threads, int64_t abundanceThreshold)
+		{
+			this_ = this;
+			if (k_ <= 0 || int64_t(index.k) != k_)
+			{
+				throw std::runtime_error("The LCB index was built with a different k");
+			}
+
+			int64_t maxId = 0;
+			MemoryJunctionSource source;
+			std::unordered_map<std::string, int64_t> kmerId;
+			std::unique_ptr<RunReport::Phase> mapping(new RunReport::Phase(report_, "map_junctions"));
+			for (size_t c = 0; c < index.chr.size(); c++)
+			{
+				LcbIndex::Chromosome & chr = index.chr[c];
+				sequence_.push_back(std::string());
+				sequence_.back().swap(chr.sequence);
+				sequenceDescription_.push_back(chr.description);
+				sequenceId_[chr.description] = c;
+				for (size_t i = 0; i < chr.id.size(); i++)
+				{
+					std::string kmer = sequence_[c].substr(chr.pos[i], k_);
+					source.Add(TwoPaCo::JunctionPosition(uint32_t(c), chr.pos[i], chr.id[i]));
+					maxId = max(maxId, int64_t(abs(chr.id[i])));
+					kmerId.insert(std::make_pair(kmer, int64_t(chr.id[i])));
+					std::reverse(kmer.begin(), kmer.end());
+					std::transform(kmer.begin(), kmer.end(), kmer.begin(), TwoPaCo::DnaChar::ReverseChar);
+					kmerId.insert(std::make_pair(kmer, -int64_t(chr.id[i])));
+				}
+			}
+
+			size_t oldChrNumber = sequence_.size();
+			for (TwoPaCo::StreamFastaParser parser(newGenomesFileName); parser.ReadRecord();)
+			{
+				sequence_.push_back(std::string());
+				sequenceDescription_.push_back(parser.GetCurrentHeader());
+				sequenceId_[parser.GetCurrentHeader()] = sequenceDescription_.size() - 1;
+				for (char ch; parser.GetChar(ch); )
+				{
+					sequence_.back().push_back(ch);
+				}
+			}
+
+			std::string kmer;
+			std::unordered_map<int64_t, int64_t> freshId;
+			std::vector<std::vector<std::pair<uint32_t, int64_t> > > own(sequence_.size() - oldChrNumber);
+			auto addOwn = [&](const TwoPaCo::JunctionPosition & junction)
+			{
+				size_t chr = oldChrNumber + junction.GetChr();
+				if (chr < sequence_.size() && junction.GetPos() + size_t(k_) <= sequence_[chr].size())
+				{
+					kmer.assign(sequence_[chr], junction.GetPos(), k_);
+					if (kmerId.count(kmer) == 0)
 					{
-						chr++;
-						idx = 0;
+						auto it = freshId.insert(std::make_pair(int64_t(abs(junction.GetId())), maxId + 1)).first;
+						maxId = max(maxId, it->second);
+						own[junction.GetChr()].push_back(std::make_pair(junction.GetPos(), junction.GetId() > 0 ? it->second : -it->second));
 					}
+				}
+			};
 
-					size_t absId = abs(junction.GetId());
-					if (abundance[absId] < size_t(abundanceThreshold) && buffer.AddAndCheck(junction))
+			if (!newGraphFileName.empty())
+			{
+				ReadJunctions(newGraphFileName, addOwn);
+			}
+
+			for (size_t c = oldChrNumber; c < sequence_.size(); c++)
+			{
+				const std::vector<std::pair<uint32_t, int64_t> > & ownJunction = own[c - oldChrNumber];
+				auto jt = ownJunction.begin();
+				for (size_t pos = 0; pos + k_ <= sequence_[c].size(); pos++)
+				{
+					for (; jt != ownJunction.end() && jt->first < pos; ++jt)
 					{
-						position_[junction.GetChr()][idx].Assign(junction);
-						vertex_[absId].push_back(Vertex(junction));
-						vertex_[absId].back().idx = idx++;
+						source.Add(TwoPaCo::JunctionPosition(uint32_t(c), jt->first, jt->second));
 					}
-					else
-					{
 
+					kmer.assign(sequence_[c], pos, k_);
+					auto it = kmerId.find(kmer);
+					if (it != kmerId.end())
+					{
+						source.Add(TwoPaCo::JunctionPosition(uint32_t(c), uint32_t(pos), it->second));
 					}
 				}
-			}
 
+				for (; jt != ownJunction.end(); ++jt)
+				{
+					source.Add(TwoPaCo::JunctionPosition(uint32_t(c), jt->first, jt->second));
+				}
+			}
 
-			size_t record = 0;
-			sequence_.resize(position_.size());
-			for (TwoPaCo::StreamFastaParser parser(genomesFileName); parser.ReadRecord(); record++)
+			mapping.reset();
+			chrSize_.assign(sequence_.size(), 0);
 			{
-				sequenceDescription_.push_back(parser.GetCurrentHeader());
-				sequenceId_[parser.GetCurrentHeader()] = sequenceDescription_.size() - 1;
-				for (char ch; parser.GetChar(ch); )
+				RunReport::Phase phase(report_, "build_positions", threads);
+				if (threads > 1)
 				{
-					sequence_[record].push_back(ch);
+					BuildPositionsParallel(source, threads, abundanceThreshold);
+				}
+				else
+				{
+					BuildPositions(source, abundanceThreshold, 0);
 				}
 			}
 
+			FinishInit(threads);
+		}
+
+		void FinishInit(int64_t threads)
+		{
+			RunReport::Phase phase(report_, "fill_vertex_chars");
+			if (sequence_.size() < position_.size())
+			{
+				sequence_.resize(position_.size());
+			}
+
 			for (size_t i = 0; i < vertex_.size(); i++)
 			{
 				for (size_t j = 0; j < vertex_[i].size(); j++)
@@ -850,12 +1404,133 @@ namespace Sibelia
 				for (; size_t(int64_t(1) << chrSizeBits_[i]) <= chrSize_[i]; chrSizeBits_[i]++);
 				chrSizeBits_[i] = max(int64_t(0), chrSizeBits_[i] - mutexBits_);
 			}
+
+			if (report_ != 0)
+			{
+				uint64_t occurrences = 0;
+				uint64_t bases = 0;
+				for (const VertexVector & now : vertex_)
+				{
+					occurrences += now.size();
+				}
+
+				for (const std::string & now : sequence_)
+				{
+					bases += now.size();
+				}
+
+				report_->SetArray("positions", GetPositionsNumber(), GetPositionsNumber() * sizeof(Position));
+				report_->SetArray("vertex_occurrences", occurrences, occurrences * sizeof(Vertex));
+				report_->SetArray("sequences", bases, bases);
+				report_->SetArray("lock_stripes", mutex_.size() * MutexNumber(), mutex_.size() * MutexNumber() * sizeof(FlaggedMutex));
+			}
+		}
+
+		// Phases of the construction and the array sizes are added to report
+		void SetReport(RunReport * report)
+		{
+			report_ = report;
+		}
+
+		// Junctions with the abundance from the threshold of Init up to
+		// repeatAbundance are kept as repeat vertices instead of being dropped.
+		// Path extension looks up their occurrences near its instances only.
+		void SetRepeatAbundance(int64_t repeatAbundance)
+		{
+			repeatAbundance_ = repeatAbundance;
+		}
+
+		// Spreads chromosomes over the nodes and moves the positions, sequence and
+		// lock stripes of each chromosome into memory first touched on its node
+		void Distribute(const NumaTopology & topology)
+		{
+			std::vector<size_t> load(topology.GetNodesNumber(), 0);
+			std::vector<size_t> order(GetChrNumber());
+			for (size_t i = 0; i < order.size(); i++)
+			{
+				order[i] = i;
+			}
+
+			std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return chrSize_[a] > chrSize_[b]; });
+			chrNode_.assign(GetChrNumber(), 0);
+			for (size_t chr : order)
+			{
+				size_t node = std::min_element(load.begin(), load.end()) - load.begin();
+				chrNode_[chr] = node;
+				load[node] += chrSize_[chr];
+			}
+
+			topology.RunOnEachNode([this](size_t node)
+			{
+				for (size_t chr = 0; chr < chrNode_.size(); chr++)
+				{
+					if (chrNode_[chr] == node)
+					{
+						std::unique_ptr<Position[]> position(new Position[chrSize_[chr]]);
+						for (size_t i = 0; i < chrSize_[chr]; i++)
+						{
+							position[i].id = position_[chr][i].id;
+							position[i].pos = position_[chr][i].pos;
+							position[i].used = position_[chr][i].used.load();
+						}
+
+						position_[chr].swap(position);
+						std::string(sequence_[chr]).swap(sequence_[chr]);
+						mutex_[chr].reset(new FlaggedMutex[MutexNumber()]);
+					}
+				}
+			});
 		}
 
-		JunctionStorage() {}
-		JunctionStorage(const std::string & fileName, const std::string & genomesFileName, uint64_t k, int64_t threads, int64_t abundanceThreshold, int64_t loopThreshold) : k_(k)
+		uint64_t GetPositionsNumber() const
 		{
-			Init(fileName, genomesFileName, threads, abundanceThreshold, loopThreshold);
+			uint64_t ret = 0;
+			for (size_t size : chrSize_)
+			{
+				ret += size;
+			}
+
+			return ret;
+		}
+
+		// Clears the used flags left by a search, so another can run on the storage
+		void ResetUsed()
+		{
+			for (size_t chr = 0; chr < chrSize_.size(); chr++)
+			{
+				for (size_t idx = 0; idx < chrSize_[chr]; idx++)
+				{
+					position_[chr][idx].used.store(false, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// Positions claimed by other processes sharing the map count as used
+		void AttachUsedMap(SharedUsedMap * usedMap)
+		{
+			usedMap_ = usedMap;
+			chrOffset_.assign(1, 0);
+			for (size_t size : chrSize_)
+			{
+				chrOffset_.push_back(chrOffset_.back() + size);
+			}
+		}
+
+		bool HasUsedMap() const
+		{
+			return usedMap_ != 0;
+		}
+
+		size_t GetChrNode(uint64_t chrId) const
+		{
+			return chrNode_.empty() ? 0 : chrNode_[chrId];
+		}
+
+		JunctionStorage() : usedMap_(0), report_(0), repeatAbundance_(0), repeatThreshold_(SIZE_MAX) {}
+		JunctionStorage(uint64_t k) : k_(k), usedMap_(0), report_(0), repeatAbundance_(0), repeatThreshold_(SIZE_MAX) {}
+		JunctionStorage(const std::string & fileName, const std::string & genomesFileName, uint64_t k, int64_t threads, int64_t abundanceThreshold, int64_t loopThreshold, bool stream = false) : k_(k), usedMap_(0), report_(0), repeatAbundance_(0), repeatThreshold_(SIZE_MAX)
+		{
+			Init(fileName, genomesFileName, threads, abundanceThreshold, loopThreshold, stream);
 		}
 
 		bool IsSequencePresent(const std::string & str) const
@@ -876,6 +1551,11 @@ namespace Sibelia
 			char ch;
 		};
 
+		bool IsUsedPosition(size_t chrId, size_t idx) const
+		{
+			return position_[chrId][idx].used || (usedMap_ != 0 && usedMap_->Test(chrOffset_[chrId] + idx));
+		}
+
 		size_t MutexIdx(size_t chrId, size_t idx) const
 		{
 			size_t ret = idx >> chrSizeBits_[chrId];
@@ -902,6 +1582,12 @@ namespace Sibelia
 		std::vector<std::string> sequenceDescription_;		
 		std::vector<int64_t> chrSizeBits_;
 		std::vector<size_t> chrSize_;
+		std::vector<size_t> chrNode_;
+		std::vector<uint64_t> chrOffset_;
+		SharedUsedMap * usedMap_;
+		RunReport * report_;
+		int64_t repeatAbundance_;
+		size_t repeatThreshold_;
 		std::vector<VertexVector> vertex_;
 		std::vector<std::unique_ptr<Position[]> > position_;
 		std::vector<std::unique_ptr<FlaggedMutex[]> > mutex_;
@@ -0,0 +1,239 @@
+#ifndef _KMER_JUNCTIONS_H_
+#define _KMER_JUNCTIONS_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <unordered_map>
+
+#include <tbb/task_arena.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+#include <junctionapi.h>
+
+namespace Sibelia
+{
+	// Finds the junctions of the compacted de Bruijn graph of a few genomes
+	// in memory, for inputs small enough to skip TwoPaCo. A junction is a
+	// k-mer with other than one distinct neighbour on either side, or one
+	// next to the end of a sequence or to a character other than ACGT; k-mers
+	// with such characters are not vertices. Ids are numbered by the first
+	// occurrence, positive if the k-mer is not greater than its reverse
+	// complement, which is what TwoPaCo reports as well.
+	//
+	// The neighbours are gathered by workers over slices of the sequences in
+	// maps sharded by k-mer, each worker buffering its updates per shard. A
+	// second parallel pass picks the junctions and ids are given serially.
+	class KmerJunctionFinder
+	{
+	public:
+		static const size_t MAX_K = 31;
+
+		KmerJunctionFinder(size_t k) : k_(k)
+		{
+			if (k > MAX_K || k % 2 == 0)
+			{
+				throw std::runtime_error("The built-in junction finder supports odd k up to 31");
+			}
+		}
+
+		// Calls f with every junction in the order of chromosomes and positions
+		template<class F>
+		void Find(const std::vector<std::string> & sequence, int64_t threads, F f) const
+		{
+			std::vector<Slice> slice;
+			for (size_t chr = 0; chr < sequence.size(); chr++)
+			{
+				for (size_t start = 0; start + k_ <= sequence[chr].size(); start += SLICE_SIZE)
+				{
+					slice.push_back(Slice(chr, start, std::min(start + SLICE_SIZE, sequence[chr].size() - k_ + 1)));
+				}
+			}
+
+			std::vector<Shard> shard(SHARDS);
+			tbb::task_arena arena(static_cast<int>(threads));
+			arena.execute([&]()
+			{
+				tbb::parallel_for(tbb::blocked_range<size_t>(0, slice.size(), 1), [&](const tbb::blocked_range<size_t> & range)
+				{
+					std::vector<std::vector<std::pair<uint64_t, uint16_t> > > buffer(SHARDS);
+					for (size_t s = range.begin(); s != range.end(); s++)
+					{
+						ForEachKmer(sequence[slice[s].chr], slice[s], [&](size_t, uint64_t kmer, bool forward, int prev, int next)
+						{
+							std::vector<std::pair<uint64_t, uint16_t> > & now = buffer[ShardOf(kmer)];
+							now.push_back(std::make_pair(kmer, forward ? uint16_t(Bit(prev) | (Bit(next) << 5)) : uint16_t(Bit(Complement(next)) | (Bit(Complement(prev)) << 5))));
+							if (now.size() >= BUFFER_SIZE)
+							{
+								shard[ShardOf(kmer)].Flush(now);
+							}
+						});
+					}
+
+					for (size_t i = 0; i < SHARDS; i++)
+					{
+						shard[i].Flush(buffer[i]);
+					}
+				});
+			});
+
+			std::vector<std::vector<Occurrence> > found(slice.size());
+			arena.execute([&]()
+			{
+				tbb::parallel_for(tbb::blocked_range<size_t>(0, slice.size(), 1), [&](const tbb::blocked_range<size_t> & range)
+				{
+					for (size_t s = range.begin(); s != range.end(); s++)
+					{
+						ForEachKmer(sequence[slice[s].chr], slice[s], [&](size_t pos, uint64_t kmer, bool forward, int, int)
+						{
+							uint16_t mask = shard[ShardOf(kmer)].vertex.find(kmer)->second.mask;
+							if (Degree(mask & 0x1f) != 1 || Degree(mask >> 5) != 1 || (mask & (Bit(BORDER) | (Bit(BORDER) << 5))) != 0)
+							{
+								found[s].push_back(Occurrence(uint32_t(pos), kmer, forward));
+							}
+						});
+					}
+				});
+			});
+
+			int64_t vertices = 0;
+			for (size_t s = 0; s < slice.size(); s++)
+			{
+				for (const Occurrence & now : found[s])
+				{
+					int64_t & id = shard[ShardOf(now.kmer)].vertex.find(now.kmer)->second.id;
+					id = id == 0 ? ++vertices : id;
+					f(TwoPaCo::JunctionPosition(uint32_t(slice[s].chr), now.pos, now.forward ? id : -id));
+				}
+
+				std::vector<Occurrence>().swap(found[s]);
+			}
+		}
+
+	private:
+		static const int BORDER = 4;
+		static const size_t SHARDS = 256;
+		static const size_t SLICE_SIZE = size_t(1) << 20;
+		static const size_t BUFFER_SIZE = size_t(1) << 12;
+
+		struct Slice
+		{
+			size_t chr;
+			size_t start;
+			size_t end;
+			Slice(size_t chr, size_t start, size_t end) : chr(chr), start(start), end(end) {}
+		};
+
+		struct Occurrence
+		{
+			uint32_t pos;
+			uint64_t kmer;
+			bool forward;
+			Occurrence(uint32_t pos, uint64_t kmer, bool forward) : pos(pos), kmer(kmer), forward(forward) {}
+		};
+
+		struct Vertex
+		{
+			uint16_t mask;
+			int64_t id;
+			Vertex() : mask(0), id(0) {}
+		};
+
+		struct Shard
+		{
+			std::mutex mutex;
+			std::unordered_map<uint64_t, Vertex> vertex;
+
+			void Flush(std::vector<std::pair<uint64_t, uint16_t> > & buffer)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				for (auto & now : buffer)
+				{
+					vertex[now.first].mask |= now.second;
+				}
+
+				buffer.clear();
+			}
+		};
+
+		static size_t ShardOf(uint64_t kmer)
+		{
+			return size_t((kmer * 0x9E3779B97F4A7C15ULL) >> 56);
+		}
+
+		static int Code(char ch)
+		{
+			switch (ch)
+			{
+			case 'A':
+			case 'a':
+				return 0;
+			case 'C':
+			case 'c':
+				return 1;
+			case 'G':
+			case 'g':
+				return 2;
+			case 'T':
+			case 't':
+				return 3;
+			}
+
+			return BORDER;
+		}
+
+		static int Complement(int code)
+		{
+			return code == BORDER ? BORDER : 3 - code;
+		}
+
+		static uint16_t Bit(int code)
+		{
+			return uint16_t(1) << code;
+		}
+
+		static int Degree(uint16_t mask)
+		{
+			int ret = 0;
+			for (; mask != 0; mask &= mask - 1)
+			{
+				ret++;
+			}
+
+			return ret;
+		}
+
+		// Calls f with the position of every k-mer of seq starting in the slice,
+		// its canonical code, whether it is the k-mer itself rather than its
+		// reverse complement, and the codes of the characters around it
+		template<class F>
+		void ForEachKmer(const std::string & seq, const Slice & slice, F f) const
+		{
+			size_t valid = 0;
+			uint64_t fwd = 0;
+			uint64_t rev = 0;
+			uint64_t mask = (uint64_t(1) << (2 * k_)) - 1;
+			for (size_t i = slice.start; i < slice.end + k_ - 1; i++)
+			{
+				int code = Code(seq[i]);
+				valid = code == BORDER ? 0 : valid + 1;
+				fwd = ((fwd << 2) | uint64_t(code & 3)) & mask;
+				rev = (rev >> 2) | (uint64_t(3 - (code & 3)) << (2 * (k_ - 1)));
+				if (valid >= k_)
+				{
+					size_t start = i + 1 - k_;
+					int prev = start > 0 ? Code(seq[start - 1]) : BORDER;
+					int next = i + 1 < seq.size() ? Code(seq[i + 1]) : BORDER;
+					f(start, std::min(fwd, rev), fwd <= rev, prev, next);
+				}
+			}
+		}
+
+		size_t k_;
+	};
+}
+
+#endif
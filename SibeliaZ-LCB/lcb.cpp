@@ -0,0 +1,106 @@
+#include <mutex>
+
+#include "lcb.h"
+#include "blocksfinder.h"
+
+namespace Sibelia
+{
+	namespace
+	{
+		void Split(const std::vector<LcbSequence> & sequence, std::vector<std::string> & description, std::vector<std::string> & copy)
+		{
+			for (const LcbSequence & now : sequence)
+			{
+				description.push_back(now.description);
+				copy.push_back(now.sequence);
+			}
+		}
+
+		void Search(const LcbOptions & options, const std::vector<std::string> & description, std::vector<std::string> & sequence,
+			const JunctionStorage::MemoryJunctionSource & source, const std::function<void(const LcbBlock &)> & f)
+		{
+			static std::mutex runMutex;
+			std::lock_guard<std::mutex> lock(runMutex);
+			JunctionStorage storage(options.k);
+			storage.SetRepeatAbundance(options.repeatAbundance);
+			storage.Init(description, sequence, source, options.threads, options.abundanceThreshold);
+			BlocksFinder finder(storage, options.k);
+			finder.SetVerbose(options.verbose);
+			finder.SetPruning(options.pruning);
+			finder.FindBlocks(options.minBlockSize, options.maxBranchSize, options.maxBranchSize, 8, 0, options.threads, "");
+
+			LcbBlock block;
+			finder.ForEachBlock(OUTPUT_BUCKET_SIZE, [&](BlockList::const_iterator begin, BlockList::const_iterator end)
+			{
+				block.id = begin->GetBlockId();
+				block.instance.clear();
+				for (BlockList::const_iterator it = begin; it != end; ++it)
+				{
+					LcbInstance instance;
+					instance.chr = it->GetChrId();
+					instance.start = it->GetStart();
+					instance.end = it->GetEnd();
+					instance.positive = it->GetDirection();
+					block.instance.push_back(instance);
+				}
+
+				f(block);
+			});
+		}
+	}
+
+	void FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence, const std::vector<LcbJunction> & junction,
+		const std::function<void(const LcbBlock &)> & f)
+	{
+		if (options.k <= 0 || options.k % 2 == 0)
+		{
+			throw std::runtime_error("The value of k must be odd");
+		}
+
+		JunctionStorage::MemoryJunctionSource source;
+		for (size_t i = 0; i < junction.size(); i++)
+		{
+			const LcbJunction & now = junction[i];
+			if (now.chr >= sequence.size() || now.pos + size_t(options.k) > sequence[now.chr].sequence.size() || now.id == 0)
+			{
+				throw std::runtime_error("A junction is out of the sequences or has id 0");
+			}
+
+			if (i > 0 && (now.chr < junction[i - 1].chr || (now.chr == junction[i - 1].chr && now.pos <= junction[i - 1].pos)))
+			{
+				throw std::runtime_error("The junctions are not ordered by chromosome and position");
+			}
+
+			source.Add(TwoPaCo::JunctionPosition(now.chr, now.pos, now.id));
+		}
+
+		std::vector<std::string> description;
+		std::vector<std::string> copy;
+		Split(sequence, description, copy);
+		Search(options, description, copy, source, f);
+	}
+
+	void FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence, const std::function<void(const LcbBlock &)> & f)
+	{
+		std::vector<std::string> description;
+		std::vector<std::string> copy;
+		Split(sequence, description, copy);
+		JunctionStorage::MemoryJunctionSource source;
+		KmerJunctionFinder(options.k).Find(copy, options.threads, [&source](const TwoPaCo::JunctionPosition & junction) { source.Add(junction); });
+		Search(options, description, copy, source, f);
+	}
+
+	std::vector<LcbBlock> FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence, const std::vector<LcbJunction> & junction)
+	{
+		std::vector<LcbBlock> ret;
+		FindLcbs(options, sequence, junction, [&ret](const LcbBlock & block) { ret.push_back(block); });
+		return ret;
+	}
+
+	std::vector<LcbBlock> FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence)
+	{
+		std::vector<LcbBlock> ret;
+		FindLcbs(options, sequence, [&ret](const LcbBlock & block) { ret.push_back(block); });
+		return ret;
+	}
+}
@@ -0,0 +1,83 @@
+#ifndef _LCB_H_
+#define _LCB_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+// The programmatic interface of libsibeliaz-lcb. It depends on nothing but
+// the standard library, the search itself is in blocksfinder.h.
+namespace Sibelia
+{
+	// The parameters of sibeliaz-lcb with its defaults
+	struct LcbOptions
+	{
+		int64_t k;
+		int64_t minBlockSize;
+		int64_t maxBranchSize;
+		int64_t abundanceThreshold;
+		int64_t repeatAbundance;
+		int64_t threads;
+		bool pruning;
+		bool verbose;
+
+		LcbOptions() : k(25), minBlockSize(200), maxBranchSize(200), abundanceThreshold(150), repeatAbundance(0), threads(1), pruning(false), verbose(false)
+		{
+
+		}
+	};
+
+	struct LcbSequence
+	{
+		std::string description;
+		std::string sequence;
+
+		LcbSequence() {}
+		LcbSequence(const std::string & description, const std::string & sequence) : description(description), sequence(sequence) {}
+	};
+
+	// An occurrence of the junction id in chromosome chr starting at pos, as
+	// TwoPaCo reports them: the id is negative on the reverse strand
+	struct LcbJunction
+	{
+		uint32_t chr;
+		uint32_t pos;
+		int64_t id;
+
+		LcbJunction() {}
+		LcbJunction(uint32_t chr, uint32_t pos, int64_t id) : chr(chr), pos(pos), id(id) {}
+	};
+
+	// Coordinates are 0-based and the end is exclusive, as in BlockInstance
+	struct LcbInstance
+	{
+		size_t chr;
+		uint64_t start;
+		uint64_t end;
+		bool positive;
+	};
+
+	struct LcbBlock
+	{
+		int64_t id;
+		std::vector<LcbInstance> instance;
+	};
+
+	// Searches the blocks of sequence given the junctions of its de Bruijn
+	// graph, ordered by chromosome and position, and passes them to f in the
+	// order of ids. Calls run one at a time, since the storage of the graph
+	// is a process-wide singleton. Invalid input throws std::runtime_error.
+	void FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence, const std::vector<LcbJunction> & junction,
+		const std::function<void(const LcbBlock &)> & f);
+
+	std::vector<LcbBlock> FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence, const std::vector<LcbJunction> & junction);
+
+	// The same with the junctions found in memory, for small inputs and k up
+	// to 31, as sibeliaz-lcb --build-graph does
+	void FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence, const std::function<void(const LcbBlock &)> & f);
+
+	std::vector<LcbBlock> FindLcbs(const LcbOptions & options, const std::vector<LcbSequence> & sequence);
+}
+
+#endif
@@ -0,0 +1,333 @@
+#include <thread>
+#include <chrono>
+#include <iomanip>
+
+#include <tclap/CmdLine.h>
+
+#include "blocksfinder.h"
+#include "syntheticgenomes.h"
+
+namespace Sibelia
+{
+	// Drives the private steps of the search the way ProcessVertex does, but
+	// only forward and with every step timed
+	class BlocksFinderBenchmark
+	{
+	public:
+		struct Timing
+		{
+			size_t calls;
+			double seconds;
+
+			Timing() : calls(0), seconds(0)
+			{
+
+			}
+
+			template<class F>
+			auto operator()(F f) -> decltype(f())
+			{
+				Stopwatch watch(*this);
+				return f();
+			}
+
+		private:
+			struct Stopwatch
+			{
+				Timing & timing;
+				std::chrono::steady_clock::time_point start;
+
+				Stopwatch(Timing & timing) : timing(timing), start(std::chrono::steady_clock::now())
+				{
+
+				}
+
+				~Stopwatch()
+				{
+					timing.calls++;
+					timing.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+				}
+			};
+		};
+
+		static void ExtendSeeds(BlocksFinder & finder, const std::vector<int64_t> & seed, Timing & popular, Timing & push, Timing & score, Timing & finalize)
+		{
+			JunctionStorage & storage = finder.storage_;
+			std::vector<size_t> data;
+			std::vector<uint32_t> count(storage.GetVerticesNumber() * 2 + 1, 0);
+			Path finalizer(storage, finder.maxBranchSize_, finder.minBlockSize_, finder.minBlockSize_, finder.maxFlankingSize_);
+			Path currentPath(storage, finder.maxBranchSize_, finder.minBlockSize_, finder.minBlockSize_, finder.maxFlankingSize_);
+			for (int64_t vid : seed)
+			{
+				currentPath.Init(vid);
+				if (currentPath.AllInstances().size() >= 2)
+				{
+					int64_t bestScore = 0;
+					size_t bestLeftSize = currentPath.LeftSize();
+					size_t bestRightSize = currentPath.RightSize();
+					for (bool success = true; success;)
+					{
+						auto next = popular([&]() { return finder.MostPopularVertex(currentPath, true, count, data); });
+						success = false;
+						for (auto it = next.second.origin; next.first != 0 && it.GetVertexId() != next.first; ++it)
+						{
+							success = push([&]() { return currentPath.PointPushBack(it.OutgoingEdge()); });
+							if (success)
+							{
+								int64_t nowScore = score([&]() { return currentPath.Score(finder.scoreFullChains_); });
+								if (nowScore > bestScore)
+								{
+									bestScore = nowScore;
+									bestRightSize = currentPath.RightSize();
+								}
+							}
+						}
+					}
+
+					if (bestScore > 0)
+					{
+						finalize([&]() { return finder.TryFinalizeBlock(currentPath, finalizer, bestRightSize, bestLeftSize); });
+					}
+				}
+
+				currentPath.Clear();
+			}
+		}
+
+		// Extends every seed both ways as ExtendPathForward and ExtendPathBackward
+		// do and, before each step onto a repeat vertex, checks that the lookup
+		// near the instances misses no occurrence a full scan would take.
+		// Returns the steps checked and the ones that missed.
+		static std::pair<size_t, size_t> CheckRepeatLookups(BlocksFinder & finder, const std::vector<int64_t> & seed)
+		{
+			JunctionStorage & storage = finder.storage_;
+			std::pair<size_t, size_t> ret(0, 0);
+			std::vector<size_t> data;
+			std::vector<uint32_t> count(storage.GetVerticesNumber() * 2 + 1, 0);
+			Path currentPath(storage, finder.maxBranchSize_, finder.minBlockSize_, finder.minBlockSize_, finder.maxFlankingSize_);
+			for (int64_t vid : seed)
+			{
+				if (storage.IsRepeat(vid))
+				{
+					continue;
+				}
+
+				currentPath.Init(vid);
+				for (bool forward : { true, false })
+				{
+					for (bool success = currentPath.AllInstances().size() >= 2; success;)
+					{
+						auto next = finder.MostPopularVertex(currentPath, forward, count, data);
+						success = false;
+						for (auto it = next.second.origin; next.first != 0 && it.GetVertexId() != next.first; forward ? ++it : --it)
+						{
+							Edge e = forward ? it.OutgoingEdge() : it.IngoingEdge();
+							int64_t vertex = forward ? e.GetEndVertex() : e.GetStartVertex();
+							if (storage.IsRepeat(vertex) && !currentPath.IsInPath(vertex))
+							{
+								ret.first++;
+								ret.second += currentPath.NearOccurrencesComplete(e, forward) ? 0 : 1;
+							}
+
+							success = forward ? currentPath.PointPushBack(e) : currentPath.PointPushFront(e);
+						}
+					}
+				}
+
+				currentPath.Clear();
+			}
+
+			return ret;
+		}
+
+		static void InitSearch(BlocksFinder & finder, int64_t minBlockSize, int64_t maxBranchSize)
+		{
+			finder.InitSearch(minBlockSize, maxBranchSize, maxBranchSize, 8, 0, 1);
+		}
+
+		static int64_t GetBlocksFound(const BlocksFinder & finder)
+		{
+			return finder.blocksFound_;
+		}
+
+		static size_t WriteGff(const BlocksFinder & finder, const std::string & fileName)
+		{
+			return finder.ListBlocksIndicesGFF(fileName, true);
+		}
+	};
+}
+
+namespace
+{
+	template<class F>
+	double Measure(F f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void PrintTiming(const std::string & name, const Sibelia::BlocksFinderBenchmark::Timing & timing)
+	{
+		std::cout << std::left << std::setw(24) << name << std::right << std::setw(12) << timing.calls << std::setw(14) << std::fixed << std::setprecision(3) <<
+			timing.seconds * 1e3 << std::setw(14) << std::setprecision(1) << (timing.calls > 0 ? timing.seconds * 1e9 / timing.calls : 0.0) << std::endl;
+	}
+
+	// The progress of the search goes to a null stream while it is timed
+	struct SilentCout
+	{
+		std::streambuf * saved;
+		std::ofstream null;
+
+		SilentCout() : saved(std::cout.rdbuf()), null("/dev/null")
+		{
+			std::cout.rdbuf(null.rdbuf());
+		}
+
+		~SilentCout()
+		{
+			std::cout.rdbuf(saved);
+		}
+	};
+}
+
+// Generates genomes with SyntheticGenomes, times the steps of the search on
+// them and runs the whole search at 1, 2, 4, ... up to the given threads
+int main(int argc, char * argv[])
+{
+	try
+	{
+		TCLAP::CmdLine cmd("Benchmarks of SibeliaZ-LCB on synthetic genomes", ' ', Sibelia::VERSION);
+		TCLAP::ValueArg<unsigned int> genomes("", "genomes", "Number of genomes", false, 8, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> length("", "length", "Length of the ancestor", false, 1000000, "integer", cmd);
+		TCLAP::ValueArg<double> divergence("", "divergence", "Rate of substitutions in each genome", false, 0.01, "float", cmd);
+		TCLAP::ValueArg<double> repeats("", "repeats", "Share of the ancestor covered by repeats", false, 0.05, "float", cmd);
+		TCLAP::ValueArg<unsigned int> seed("", "seed", "Seed of the generator", false, 1, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> kvalue("k", "kvalue", "Value of k, odd and at most 31", false, 25, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> minBlockSize("m", "blocksize", "Minimum block size", false, 50, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> maxBranchSize("b", "branchsize", "Maximum branch size", false, 200, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> threads("t", "threads", "Maximum number of threads of the scaling run", false, std::max(1u, std::thread::hardware_concurrency()), "integer", cmd);
+		TCLAP::ValueArg<unsigned int> samples("", "samples", "Number of seeds extended by the step benchmarks", false, 20000, "integer", cmd);
+		TCLAP::ValueArg<std::string> workDir("", "workdir", "Directory for the generated files", false, ".", "directory name", cmd);
+		cmd.parse(argc, argv);
+
+		Sibelia::SyntheticGenomes::Options options;
+		options.genomes = genomes.getValue();
+		options.length = length.getValue();
+		options.divergence = divergence.getValue();
+		options.repeats = repeats.getValue();
+		options.seed = seed.getValue();
+		std::string fastaFileName = workDir.getValue() + "/bench_genomes.fa";
+		std::string graphFileName = workDir.getValue() + "/bench_graph.cjf";
+		double generate = Measure([&]()
+		{
+			Sibelia::SyntheticGenomes synthetic(options);
+			synthetic.WriteFasta(fastaFileName);
+			synthetic.WriteJunctions(graphFileName, kvalue.getValue(), threads.getValue());
+		});
+
+		std::cout << "Genomes: " << options.genomes << " x " << options.length << " bp, divergence " << options.divergence << ", repeats " << options.repeats <<
+			", generated in " << std::setprecision(2) << std::fixed << generate << " s" << std::endl << std::endl;
+
+		int64_t k = kvalue.getValue();
+		int64_t abundance = 150;
+		std::unique_ptr<Sibelia::JunctionStorage> storage;
+		std::cout << "Init, 1 thread: " << Measure([&]() { storage.reset(new Sibelia::JunctionStorage(graphFileName, fastaFileName, k, 1, abundance, 0)); }) << " s" << std::endl;
+		storage.reset();
+		std::cout << "Init, " << threads.getValue() << " threads: " <<
+			Measure([&]() { storage.reset(new Sibelia::JunctionStorage(graphFileName, fastaFileName, k, threads.getValue(), abundance, 0)); }) << " s" << std::endl;
+		std::cout << "Vertices: " << storage->GetVerticesNumber() << ", positions: " << storage->GetPositionsNumber() << std::endl << std::endl;
+
+		std::vector<int64_t> sample;
+		for (int64_t v = -storage->GetVerticesNumber() + 1; v < storage->GetVerticesNumber(); v++)
+		{
+			sample.push_back(v);
+		}
+
+		std::mt19937_64 random(seed.getValue());
+		std::shuffle(sample.begin(), sample.end(), random);
+		sample.resize(std::min(sample.size(), size_t(samples.getValue())));
+		Sibelia::BlocksFinderBenchmark::Timing popular;
+		Sibelia::BlocksFinderBenchmark::Timing push;
+		Sibelia::BlocksFinderBenchmark::Timing score;
+		Sibelia::BlocksFinderBenchmark::Timing finalize;
+		{
+			Sibelia::BlocksFinder finder(*storage, k);
+			Sibelia::BlocksFinderBenchmark::InitSearch(finder, minBlockSize.getValue(), maxBranchSize.getValue());
+			Sibelia::BlocksFinderBenchmark::ExtendSeeds(finder, sample, popular, push, score, finalize);
+		}
+
+		std::cout << std::left << std::setw(24) << "Step" << std::right << std::setw(12) << "Calls" << std::setw(14) << "Total ms" << std::setw(14) << "ns/call" << std::endl;
+		PrintTiming("MostPopularVertex", popular);
+		PrintTiming("Path::PointPushBack", push);
+		PrintTiming("Path::Score", score);
+		PrintTiming("TryFinalizeBlock", finalize);
+
+		// Junctions present more than twice per genome become repeat vertices
+		storage.reset(new Sibelia::JunctionStorage(k));
+		storage->SetRepeatAbundance(INT32_MAX);
+		storage->Init(graphFileName, fastaFileName, threads.getValue(), 2 * options.genomes + 1, 0);
+		{
+			Sibelia::BlocksFinder finder(*storage, k);
+			Sibelia::BlocksFinderBenchmark::InitSearch(finder, minBlockSize.getValue(), maxBranchSize.getValue());
+			std::pair<size_t, size_t> check = Sibelia::BlocksFinderBenchmark::CheckRepeatLookups(finder, sample);
+			std::cout << std::endl << "Repeat lookups checked on both strands: " << check.first << ", missed occurrences: " << check.second << std::endl;
+			if (check.second > 0)
+			{
+				throw std::runtime_error("The repeat lookup missed occurrences a full scan would extend");
+			}
+		}
+
+		std::vector<int64_t> scale;
+		for (int64_t t = 1; t < int64_t(threads.getValue()); t *= 2)
+		{
+			scale.push_back(t);
+		}
+
+		size_t totalLength = 0;
+		for (int64_t chr = 0; chr < storage->GetChrNumber(); chr++)
+		{
+			totalLength += storage->GetChrSequence(chr).size();
+		}
+
+		double single = 0;
+		scale.push_back(threads.getValue());
+		std::cout << std::endl << std::setw(8) << "Threads" << std::setw(12) << "Search s" << std::setw(10) << "Speedup" << std::setw(12) << "Efficiency" <<
+			std::setw(10) << "Blocks" << std::setw(10) << "Coverage" << std::endl;
+		for (int64_t t : scale)
+		{
+			storage.reset();
+			storage.reset(new Sibelia::JunctionStorage(graphFileName, fastaFileName, k, t, abundance, 0));
+			Sibelia::BlocksFinder finder(*storage, k);
+			double search = 0;
+			{
+				SilentCout silent;
+				search = Measure([&]() { finder.FindBlocks(minBlockSize.getValue(), maxBranchSize.getValue(), maxBranchSize.getValue(), 8, 0, t, "/dev/null"); });
+			}
+
+			size_t covered = 0;
+			std::string gffFileName = workDir.getValue() + "/bench_blocks.gff";
+			double gff = Measure([&]() { covered = Sibelia::BlocksFinderBenchmark::WriteGff(finder, gffFileName); });
+			std::remove(gffFileName.c_str());
+			single = t == 1 ? search : single;
+			std::cout << std::setw(8) << t << std::setw(12) << std::setprecision(3) << search << std::setw(10) << std::setprecision(2) << single / search <<
+				std::setw(12) << single / search / t << std::setw(10) << Sibelia::BlocksFinderBenchmark::GetBlocksFound(finder) << std::setw(10) << double(covered) / totalLength << std::endl;
+			if (t == 1)
+			{
+				std::cout << "(GFF output: " << std::setprecision(3) << gff << " s)" << std::endl;
+			}
+		}
+	}
+	catch (TCLAP::ArgException & e)
+	{
+		std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+	catch (std::runtime_error & e)
+	{
+		std::cerr << "error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
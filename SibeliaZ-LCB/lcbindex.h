@@ -0,0 +1,109 @@
+#ifndef _LCB_INDEX_H_
+#define _LCB_INDEX_H_
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "binaryio.h"
+
+namespace Sibelia
+{
+	// A saved LCB run: the genomes, the junction positions left after the
+	// abundance filter and the block assignment of each of them, so new
+	// genomes can be added later without searching the old ones again. The
+	// file is the "SZLI" magic, a version, k, the number of blocks and of
+	// chromosomes, then every chromosome as its description, sequence and the
+	// id, position, block and instance columns. Integers are 64-bit lengths
+	// and 32-bit columns in the native byte order.
+	class LcbIndex
+	{
+	public:
+		static const uint32_t VERSION = 1;
+		// The six lengths a saved chromosome takes at least
+		static const uint64_t CHROMOSOME_BYTES = 6 * sizeof(uint64_t);
+
+		struct Chromosome
+		{
+			std::string description;
+			std::string sequence;
+			std::vector<int32_t> id;
+			std::vector<uint32_t> pos;
+			std::vector<int32_t> block;
+			std::vector<int32_t> instance;
+		};
+
+		uint64_t k;
+		int64_t blocksFound;
+		std::vector<Chromosome> chr;
+
+		void Load(const std::string & fileName)
+		{
+			std::ifstream in(fileName.c_str(), std::ios::binary);
+			char magic[4];
+			if (!in.read(magic, sizeof(magic)) || memcmp(magic, "SZLI", sizeof(magic)) != 0 || ReadBinary<uint32_t>(in) != VERSION)
+			{
+				throw std::runtime_error(("Can't read the LCB index " + fileName).c_str());
+			}
+
+			k = ReadBinary<uint64_t>(in);
+			blocksFound = ReadBinary<int64_t>(in);
+			chr.resize(ReadBinaryLength(in, CHROMOSOME_BYTES));
+			for (Chromosome & now : chr)
+			{
+				ReadBinaryVector(in, now.description);
+				ReadBinaryVector(in, now.sequence);
+				ReadBinaryVector(in, now.id);
+				ReadBinaryVector(in, now.pos);
+				ReadBinaryVector(in, now.block);
+				ReadBinaryVector(in, now.instance);
+			}
+
+			if (!in)
+			{
+				throw std::runtime_error(("The LCB index " + fileName + " is truncated").c_str());
+			}
+		}
+
+		// Chromosomes are written one by one, so a run is saved without a copy
+		class Writer
+		{
+		public:
+			Writer(const std::string & fileName, uint64_t k, int64_t blocksFound, uint64_t chrNumber) : out_(fileName.c_str(), std::ios::binary)
+			{
+				out_.write("SZLI", 4);
+				WriteBinary(out_, VERSION);
+				WriteBinary(out_, k);
+				WriteBinary(out_, blocksFound);
+				WriteBinary(out_, chrNumber);
+			}
+
+			void WriteChromosome(const Chromosome & chr)
+			{
+				WriteBinaryVector(out_, chr.description);
+				WriteBinaryVector(out_, chr.sequence);
+				WriteBinaryVector(out_, chr.id);
+				WriteBinaryVector(out_, chr.pos);
+				WriteBinaryVector(out_, chr.block);
+				WriteBinaryVector(out_, chr.instance);
+			}
+
+			void Close()
+			{
+				out_.flush();
+				if (!out_)
+				{
+					throw std::runtime_error("Cannot write the LCB index");
+				}
+			}
+
+		private:
+			std::ofstream out_;
+		};
+	};
+}
+
+#endif
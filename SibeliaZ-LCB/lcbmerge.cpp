@@ -0,0 +1,227 @@
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdexcept>
+
+#include <climits>
+#include <dirent.h>
+#include <tclap/CmdLine.h>
+
+#include "blocksfinder.h"
+
+namespace
+{
+	struct Record
+	{
+		int64_t id;
+		std::string line;
+
+		bool operator < (const Record & record) const
+		{
+			return id < record.id;
+		}
+	};
+
+	void TryOpenFile(const std::string & fileName, std::ifstream & stream)
+	{
+		stream.open(fileName.c_str());
+		if (!stream)
+		{
+			throw std::runtime_error(("Cannot open file " + fileName).c_str());
+		}
+	}
+
+	void TryOpenFile(const std::string & fileName, std::ofstream & stream)
+	{
+		stream.open(fileName.c_str());
+		if (!stream)
+		{
+			throw std::runtime_error(("Cannot open file " + fileName).c_str());
+		}
+	}
+
+	// Reads the records of one part, shifting block ids by offset. Returns the
+	// largest id seen in the part.
+	int64_t ReadPart(const std::string & fileName, int64_t offset, std::vector<Record> & record, std::vector<std::string> & header)
+	{
+		int64_t maxId = 0;
+		std::ifstream in;
+		TryOpenFile(fileName, in);
+		for (std::string line; std::getline(in, line);)
+		{
+			if (line.size() > 1 && line[0] == '#' && line[1] == '#')
+			{
+				if (std::find(header.begin(), header.end(), line) == header.end())
+				{
+					header.push_back(line);
+				}
+
+				continue;
+			}
+
+			size_t pos = line.rfind("id=");
+			if (pos == std::string::npos)
+			{
+				continue;
+			}
+
+			int64_t id = atoll(line.c_str() + pos + 3);
+			maxId = std::max(maxId, id);
+			std::stringstream ss;
+			ss << line.substr(0, pos) << "id=" << id + offset;
+			record.push_back(Record());
+			record.back().id = id + offset;
+			record.back().line = ss.str();
+		}
+
+		return maxId;
+	}
+
+	std::string RealPath(const std::string & path)
+	{
+		char buffer[PATH_MAX];
+		if (realpath(path.c_str(), buffer) == 0)
+		{
+			throw std::runtime_error(("Cannot resolve the path " + path).c_str());
+		}
+
+		return buffer;
+	}
+
+	// Copies blocks/<id>.fa of a part under the new id, renaming the copies in
+	// the headers. The part is left as it is. Bundled sequences are refused,
+	// their index would have to be rebuilt.
+	void CopyPartSequences(const std::string & blocksDir, int64_t offset, const std::string & outBlocksDir)
+	{
+		DIR * dir = opendir(blocksDir.c_str());
+		if (dir == 0)
+		{
+			return;
+		}
+
+		for (dirent * entry; (entry = readdir(dir)) != 0;)
+		{
+			std::string name = entry->d_name;
+			if (name == "blocks.idx")
+			{
+				closedir(dir);
+				throw std::runtime_error(("The blocks of " + blocksDir + " are bundled, parts written with --bundles cannot be merged").c_str());
+			}
+
+			if (name.size() < 4 || name.substr(name.size() - 3) != ".fa" || name.find_first_not_of("0123456789") != name.size() - 3)
+			{
+				continue;
+			}
+
+			int64_t id = atoll(name.c_str()) + offset;
+			std::ifstream in;
+			std::ofstream out;
+			std::stringstream ss;
+			ss << outBlocksDir << "/" << id << ".fa";
+			TryOpenFile(blocksDir + "/" + name, in);
+			TryOpenFile(ss.str(), out);
+			for (std::string line; std::getline(in, line);)
+			{
+				size_t pos = line.find('_');
+				if (line.size() > 0 && line[0] == '>' && pos != std::string::npos)
+				{
+					out << '>' << id << line.substr(pos) << '\n';
+				}
+				else
+				{
+					out << line << '\n';
+				}
+			}
+
+		}
+
+		closedir(dir);
+	}
+}
+
+int main(int argc, char * argv[])
+{
+	try
+	{
+		TCLAP::CmdLine cmd("Merges the output of SibeliaZ-LCB processes that searched different seed partitions", ' ', Sibelia::VERSION);
+
+		TCLAP::MultiArg<std::string> inDirName("i",
+			"input",
+			"Output dir of one partition, in partition order",
+			true,
+			"directory name",
+			cmd);
+
+		TCLAP::ValueArg<std::string> outDirName("o",
+			"outdir",
+			"Output dir for the merged blocks",
+			false,
+			".",
+			"directory name",
+			cmd);
+
+		cmd.parse(argc, argv);
+
+		int64_t offset = 0;
+		std::vector<Record> record;
+		std::vector<std::string> header;
+		const std::string outBlocksDir = outDirName.getValue() + "/blocks";
+		Sibelia::CreateOutDirectory(outDirName.getValue());
+		// The merged files would overwrite the ones of a part being read
+		const std::string outPath = RealPath(outDirName.getValue());
+		for (const std::string & dir : inDirName.getValue())
+		{
+			const std::string inPath = RealPath(dir);
+			if (inPath == outPath || inPath.compare(0, outPath.size() + 1, outPath + "/") == 0 || outPath == "/")
+			{
+				throw TCLAP::ArgException("must not be an input dir or contain one", "outdir");
+			}
+		}
+
+		for (const std::string & dir : inDirName.getValue())
+		{
+			int64_t maxId = ReadPart(dir + "/blocks_coords.gff", offset, record, header);
+			DIR * blocks = opendir((dir + "/blocks").c_str());
+			if (blocks != 0)
+			{
+				closedir(blocks);
+				Sibelia::CreateOutDirectory(outBlocksDir);
+				CopyPartSequences(dir + "/blocks", offset, outBlocksDir);
+			}
+
+			offset += maxId;
+		}
+
+		std::ofstream out;
+		std::stable_sort(record.begin(), record.end());
+		TryOpenFile(outDirName.getValue() + "/blocks_coords.gff", out);
+		for (const std::string & line : header)
+		{
+			out << line << '\n';
+		}
+
+		for (const Record & r : record)
+		{
+			out << r.line << '\n';
+		}
+
+		std::cout << "Blocks merged: " << offset << std::endl;
+	}
+	catch (TCLAP::ArgException & e)
+	{
+		std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+	catch (std::runtime_error & e)
+	{
+		std::cerr << "error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,352 @@
+#ifndef _LCB_SERVER_H_
+#define _LCB_SERVER_H_
+
+#include <map>
+#include <chrono>
+#include <cctype>
+#include <cerrno>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <exception>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "blocksfinder.h"
+
+namespace Sibelia
+{
+	// Keeps the storage of a graph loaded and runs a search per request. A
+	// request is a line holding a flat JSON object, such as
+	//
+	//	{"outdir": "m100", "blocksize": 100, "branchsize": 150, "noseq": true}
+	//
+	// with "outdir" required and "blocksize", "branchsize", "threads",
+	// "noseq" and "nosort" defaulting to the options of the server. The
+	// answer is a line with "ok" and either the block count and the time or
+	// the error. {"command": "shutdown"} stops the server. Between requests
+	// the used flags and the block assignment are cleared in place.
+	class LcbServer
+	{
+	public:
+		struct Parameters
+		{
+			int64_t minBlockSize;
+			int64_t maxBranchSize;
+			int64_t threads;
+			bool genSeq;
+			bool sortById;
+		};
+
+		LcbServer(JunctionStorage & storage, BlocksFinder & finder, const Parameters & defaults) : storage_(storage), finder_(finder), defaults_(defaults)
+		{
+
+		}
+
+		// Answers the requests of in on out until the end of in
+		void Serve(std::istream & in, std::ostream & out)
+		{
+			bool running = true;
+			for (std::string line; running && std::getline(in, line);)
+			{
+				if (line.find_first_not_of(" \t\r") != std::string::npos)
+				{
+					out << Handle(line, running) << std::endl;
+				}
+			}
+		}
+
+		// Answers the requests of the clients of a Unix socket at path, one
+		// connection at a time, until a shutdown request
+		void Serve(const std::string & path)
+		{
+			sockaddr_un address;
+			std::memset(&address, 0, sizeof(address));
+			address.sun_family = AF_UNIX;
+			if (path.size() >= sizeof(address.sun_path))
+			{
+				throw std::runtime_error(("The socket path is too long: " + path).c_str());
+			}
+
+			// Only a socket left by an earlier server is replaced
+			struct stat st;
+			if (lstat(path.c_str(), &st) == 0)
+			{
+				if (!S_ISSOCK(st.st_mode))
+				{
+					throw std::runtime_error(("The socket path exists and is not a socket: " + path).c_str());
+				}
+
+				unlink(path.c_str());
+			}
+
+			std::strcpy(address.sun_path, path.c_str());
+			int server = socket(AF_UNIX, SOCK_STREAM, 0);
+			if (server < 0 || bind(server, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(server, 16) != 0)
+			{
+				throw std::runtime_error(("Cannot listen on " + path + ": " + std::strerror(errno)).c_str());
+			}
+
+			std::cout << "Listening on " << path << std::endl;
+			for (bool running = true; running;)
+			{
+				int client = accept(server, 0, 0);
+				if (client < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+
+					close(server);
+					throw std::runtime_error(("Cannot accept on " + path + ": " + std::strerror(errno)).c_str());
+				}
+
+				std::string buffer;
+				char chunk[1 << 12];
+				for (ssize_t size; running && (size = recv(client, chunk, sizeof(chunk), 0)) > 0;)
+				{
+					buffer.append(chunk, size);
+					for (size_t end; running && (end = buffer.find('\n')) != std::string::npos;)
+					{
+						std::string line = buffer.substr(0, end);
+						buffer.erase(0, end + 1);
+						if (line.find_first_not_of(" \t\r") != std::string::npos)
+						{
+							std::string answer = Handle(line, running) + '\n';
+							for (size_t sent = 0; sent < answer.size();)
+							{
+								ssize_t now = send(client, answer.data() + sent, answer.size() - sent, MSG_NOSIGNAL);
+								if (now <= 0)
+								{
+									break;
+								}
+
+								sent += now;
+							}
+						}
+					}
+				}
+
+				close(client);
+			}
+
+			close(server);
+			unlink(path.c_str());
+		}
+
+	private:
+		std::string Handle(const std::string & line, bool & running)
+		{
+			std::stringstream answer;
+			try
+			{
+				std::map<std::string, std::string> request = ParseObject(line);
+				if (request.count("command") > 0)
+				{
+					if (request["command"] != "shutdown")
+					{
+						throw std::runtime_error("Unknown command " + request["command"]);
+					}
+
+					running = false;
+					return "{\"ok\": true}";
+				}
+
+				Parameters parameters = defaults_;
+				std::string outDir;
+				for (auto & now : request)
+				{
+					if (now.first == "outdir")
+					{
+						outDir = now.second;
+					}
+					else if (now.first == "blocksize")
+					{
+						parameters.minBlockSize = Integer(now);
+					}
+					else if (now.first == "branchsize")
+					{
+						parameters.maxBranchSize = Integer(now);
+					}
+					else if (now.first == "threads")
+					{
+						parameters.threads = Integer(now);
+					}
+					else if (now.first == "noseq")
+					{
+						parameters.genSeq = !Boolean(now);
+					}
+					else if (now.first == "nosort")
+					{
+						parameters.sortById = !Boolean(now);
+					}
+					else
+					{
+						throw std::runtime_error("Unknown parameter " + now.first);
+					}
+				}
+
+				if (outDir.empty())
+				{
+					throw std::runtime_error("The request has no outdir");
+				}
+
+				auto start = std::chrono::steady_clock::now();
+				Run(parameters, outDir);
+				answer << "{\"ok\": true, \"outdir\": " << Quote(outDir) << ", \"blocks\": " << finder_.GetBlocksFound() <<
+					", \"wall_s\": " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << "}";
+			}
+			catch (std::exception & e)
+			{
+				answer.str("");
+				answer << "{\"ok\": false, \"error\": " << Quote(e.what()) << "}";
+			}
+
+			return answer.str();
+		}
+
+		// The seeds are shuffled the same way in every search, so a request
+		// finds the blocks a separate run with its parameters would
+		void Run(const Parameters & parameters, const std::string & outDir)
+		{
+			if (parameters.minBlockSize <= 0 || parameters.maxBranchSize <= 0 || parameters.threads <= 0)
+			{
+				throw std::runtime_error("The block size, branch size and threads must be positive");
+			}
+
+			RunReport report;
+			CreateOutDirectory(outDir);
+			storage_.ResetUsed();
+			finder_.SetReport(&report);
+			finder_.FindBlocks(parameters.minBlockSize, parameters.maxBranchSize, parameters.maxBranchSize, 8, 0, parameters.threads, outDir + "/paths.txt");
+			finder_.GenerateOutput(outDir, parameters.genSeq, parameters.sortById);
+			finder_.SetReport(0);
+			report.Write(outDir + "/run_report.json", parameters.threads);
+		}
+
+		static int64_t Integer(const std::pair<const std::string, std::string> & value)
+		{
+			char * end = 0;
+			long long ret = std::strtoll(value.second.c_str(), &end, 10);
+			if (value.second.empty() || *end != 0)
+			{
+				throw std::runtime_error(value.first + " must be an integer");
+			}
+
+			return ret;
+		}
+
+		static bool Boolean(const std::pair<const std::string, std::string> & value)
+		{
+			if (value.second != "true" && value.second != "false")
+			{
+				throw std::runtime_error(value.first + " must be true or false");
+			}
+
+			return value.second == "true";
+		}
+
+		static std::string Quote(const std::string & text)
+		{
+			std::string ret = "\"";
+			for (char ch : text)
+			{
+				if (ch == '"' || ch == '\\')
+				{
+					ret.push_back('\\');
+				}
+
+				ret.push_back(ch == '\n' ? ' ' : ch);
+			}
+
+			return ret + "\"";
+		}
+
+		// Strings keep their text, other values the literal they were written as
+		static std::map<std::string, std::string> ParseObject(const std::string & line)
+		{
+			size_t pos = 0;
+			std::map<std::string, std::string> ret;
+			auto skip = [&]()
+			{
+				for (; pos < line.size() && std::isspace(static_cast<unsigned char>(line[pos])); pos++);
+			};
+
+			auto expect = [&](char ch)
+			{
+				skip();
+				if (pos >= line.size() || line[pos] != ch)
+				{
+					throw std::runtime_error(std::string("The request is not a JSON object, expected ") + ch);
+				}
+
+				pos++;
+			};
+
+			auto string = [&]()
+			{
+				std::string value;
+				expect('"');
+				for (; pos < line.size() && line[pos] != '"'; pos++)
+				{
+					if (line[pos] == '\\' && pos + 1 < line.size())
+					{
+						pos++;
+					}
+
+					value.push_back(line[pos]);
+				}
+
+				expect('"');
+				return value;
+			};
+
+			expect('{');
+			skip();
+			if (pos < line.size() && line[pos] == '}')
+			{
+				return ret;
+			}
+
+			for (char next = ','; next == ','; next = line[pos++])
+			{
+				skip();
+				std::string key = string();
+				expect(':');
+				skip();
+				if (pos < line.size() && line[pos] == '"')
+				{
+					ret[key] = string();
+				}
+				else
+				{
+					size_t start = pos;
+					for (; pos < line.size() && line[pos] != ',' && line[pos] != '}' && !std::isspace(static_cast<unsigned char>(line[pos])); pos++);
+					ret[key] = line.substr(start, pos - start);
+				}
+
+				skip();
+				if (pos >= line.size() || (line[pos] != ',' && line[pos] != '}'))
+				{
+					throw std::runtime_error("The request is not a JSON object, expected , or }");
+				}
+			}
+
+			return ret;
+		}
+
+		JunctionStorage & storage_;
+		BlocksFinder & finder_;
+		Parameters defaults_;
+	};
+}
+
+#endif
@@ -0,0 +1,165 @@
+#ifndef _MAF_WRITER_H_
+#define _MAF_WRITER_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+#include <zlib.h>
+
+#include "outputgenerator.h"
+
+namespace Sibelia
+{
+	// Collects MAF records from many threads and writes them in the order of
+	// their ordinals, holding early records in a reorder buffer. Next to the
+	// file, <fileName>.idx lists "id<TAB>offset<TAB>length" for every record.
+	// With compression the file is BGZF: workers compress their own records
+	// with Encode, each record starting a new BGZF block, so the offsets in
+	// the index are ordinary file offsets (virtual offsets with a zero in-block
+	// part) and a block can be read without scanning the file.
+	class MafWriter
+	{
+	public:
+		MafWriter(const std::string & fileName, bool compress) : compress_(compress), next_(0), offset_(0), indexBuffer_(index_)
+		{
+			out_.open(fileName.c_str(), std::ios::binary);
+			index_.open((fileName + ".idx").c_str());
+			if (!out_ || !index_)
+			{
+				throw std::runtime_error(("Can't create the file " + fileName).c_str());
+			}
+
+			std::string header = "##maf version=1\n";
+			std::string data = Encode(header);
+			Write(data);
+		}
+
+		// Turns a formatted record into the bytes to be written, thread-safe
+		std::string Encode(const std::string & record) const
+		{
+			if (!compress_)
+			{
+				return record;
+			}
+
+			std::string ret;
+			for (size_t pos = 0; pos < record.size(); pos += BGZF_INPUT)
+			{
+				AppendBgzfBlock(record.data() + pos, std::min(size_t(BGZF_INPUT), record.size() - pos), ret);
+			}
+
+			return ret;
+		}
+
+		// Hands over the record number ordinal, encoded by Encode and formatted
+		// from length bytes. An empty record only advances the order.
+		void Submit(uint64_t ordinal, int64_t blockId, std::string & data, uint64_t length)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			Record & record = pending_[ordinal];
+			record.blockId = blockId;
+			record.length = length;
+			record.data.swap(data);
+			for (auto it = pending_.begin(); it != pending_.end() && it->first == next_; it = pending_.erase(it), next_++)
+			{
+				if (!it->second.data.empty())
+				{
+					indexBuffer_ << it->second.blockId << '\t' << offset_ << '\t' << it->second.length << '\n';
+					Write(it->second.data);
+				}
+			}
+		}
+
+		void Close()
+		{
+			if (!pending_.empty())
+			{
+				throw std::runtime_error("Some MAF records were never written");
+			}
+
+			if (compress_)
+			{
+				std::string eof;
+				AppendBgzfBlock(0, 0, eof);
+				Write(eof);
+			}
+
+			out_.flush();
+			indexBuffer_.Flush();
+			if (!out_)
+			{
+				throw std::runtime_error("Cannot write the alignment");
+			}
+		}
+
+	private:
+		static const size_t BGZF_INPUT = 0xff00;
+
+		struct Record
+		{
+			int64_t blockId;
+			uint64_t length;
+			std::string data;
+		};
+
+		void Write(const std::string & data)
+		{
+			out_.write(data.data(), data.size());
+			offset_ += data.size();
+		}
+
+		static void PutLittleEndian(uint32_t value, size_t bytes, std::string & out)
+		{
+			for (size_t i = 0; i < bytes; i++, value >>= 8)
+			{
+				out.push_back(char(value & 0xff));
+			}
+		}
+
+		// A gzip member with the "BC" extra field holding its total size - 1
+		static void AppendBgzfBlock(const char * data, size_t size, std::string & out)
+		{
+			static const unsigned char header[] = { 0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0 };
+			std::vector<unsigned char> cdata(compressBound(uLong(size)) + 16);
+			z_stream stream = z_stream();
+			if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			{
+				throw std::runtime_error("Cannot initialize zlib");
+			}
+
+			stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+			stream.avail_in = uInt(size);
+			stream.next_out = &cdata[0];
+			stream.avail_out = uInt(cdata.size());
+			int status = deflate(&stream, Z_FINISH);
+			size_t csize = stream.total_out;
+			deflateEnd(&stream);
+			if (status != Z_STREAM_END)
+			{
+				throw std::runtime_error("Cannot compress the alignment");
+			}
+
+			out.append(reinterpret_cast<const char*>(header), sizeof(header));
+			PutLittleEndian(uint32_t(sizeof(header) + 2 + csize + 8 - 1), 2, out);
+			out.append(reinterpret_cast<const char*>(&cdata[0]), csize);
+			PutLittleEndian(uint32_t(crc32(crc32(0, Z_NULL, 0), reinterpret_cast<const Bytef*>(data), uInt(size))), 4, out);
+			PutLittleEndian(uint32_t(size), 4, out);
+		}
+
+		bool compress_;
+		uint64_t next_;
+		uint64_t offset_;
+		std::mutex mutex_;
+		std::ofstream out_;
+		std::ofstream index_;
+		OutputBuffer indexBuffer_;
+		std::map<uint64_t, Record> pending_;
+	};
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef _NUMA_TOPOLOGY_H_
+#define _NUMA_TOPOLOGY_H_
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
+
+namespace Sibelia
+{
+	class NumaTopology
+	{
+	public:
+		// The node layout is read from sysfs. Node ids may have gaps, so the
+		// online ones are listed; nodes without CPUs, such as memory-only ones,
+		// can't run a share of the search and are left out. A positive fakeNodes
+		// replaces the layout with that many emulated nodes, each getting a
+		// round-robin share of the CPUs, so the partitioned search can be
+		// exercised on a single-node machine.
+		NumaTopology(int64_t fakeNodes = 0) : emulated_(fakeNodes > 0)
+		{
+			std::vector<int> cpu = OnlineCpus();
+			if (emulated_)
+			{
+				nodeCpu_.resize(fakeNodes);
+				for (size_t i = 0; i < cpu.size(); i++)
+				{
+					nodeCpu_[i % nodeCpu_.size()].push_back(cpu[i]);
+				}
+			}
+			else
+			{
+				std::string list;
+				std::ifstream online("/sys/devices/system/node/online");
+				std::vector<int> node = online && std::getline(online, list) ? ParseCpuList(list) : std::vector<int>();
+				for (int id : node)
+				{
+					std::ifstream in(("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist").c_str());
+					std::vector<int> nodeCpu = in && std::getline(in, list) ? ParseCpuList(list) : std::vector<int>();
+					if (!nodeCpu.empty())
+					{
+						nodeCpu_.push_back(nodeCpu);
+					}
+				}
+
+				if (nodeCpu_.empty())
+				{
+					nodeCpu_.push_back(cpu);
+				}
+			}
+		}
+
+		size_t GetNodesNumber() const
+		{
+			return nodeCpu_.size();
+		}
+
+		bool IsEmulated() const
+		{
+			return emulated_;
+		}
+
+		const std::vector<int> & GetNodeCpus(size_t node) const
+		{
+			return nodeCpu_[node];
+		}
+
+		void BindCurrentThread(size_t node) const
+		{
+#ifdef __linux__
+			if (nodeCpu_[node].size() > 0)
+			{
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				for (int cpu : nodeCpu_[node])
+				{
+					CPU_SET(cpu, &set);
+				}
+
+				sched_setaffinity(0, sizeof(set), &set);
+			}
+#endif
+		}
+
+		// Runs f(node) on one thread per node bound to that node's CPUs, so the
+		// memory f allocates and touches first is placed on the node.
+		template<class F>
+		void RunOnEachNode(F f) const
+		{
+			std::vector<std::thread> worker;
+			for (size_t node = 0; node < GetNodesNumber(); node++)
+			{
+				worker.push_back(std::thread([this, node, &f]()
+				{
+					BindCurrentThread(node);
+					f(node);
+				}));
+			}
+
+			for (auto & t : worker)
+			{
+				t.join();
+			}
+		}
+
+		class Pinner : public tbb::task_scheduler_observer
+		{
+		public:
+			Pinner(tbb::task_arena & arena, const NumaTopology & topology, size_t node) : tbb::task_scheduler_observer(arena), topology_(topology), node_(node)
+			{
+				observe(true);
+			}
+
+			~Pinner()
+			{
+				observe(false);
+			}
+
+			void on_scheduler_entry(bool)
+			{
+				topology_.BindCurrentThread(node_);
+			}
+
+		private:
+			const NumaTopology & topology_;
+			size_t node_;
+		};
+
+	private:
+
+		static std::vector<int> OnlineCpus()
+		{
+			std::vector<int> ret;
+			std::ifstream in("/sys/devices/system/cpu/online");
+			std::string list;
+			if (in && std::getline(in, list))
+			{
+				ret = ParseCpuList(list);
+			}
+
+			if (ret.empty())
+			{
+				for (unsigned i = 0; i < std::max(1u, std::thread::hardware_concurrency()); i++)
+				{
+					ret.push_back(int(i));
+				}
+			}
+
+			return ret;
+		}
+
+		static std::vector<int> ParseCpuList(const std::string & list)
+		{
+			std::vector<int> ret;
+			std::stringstream ss(list);
+			for (std::string range; std::getline(ss, range, ',');)
+			{
+				int first = 0;
+				int last = 0;
+				char dash = 0;
+				std::stringstream rs(range);
+				if (rs >> first)
+				{
+					last = (rs >> dash >> last) ? last : first;
+					for (int cpu = first; cpu <= last; cpu++)
+					{
+						ret.push_back(cpu);
+					}
+				}
+			}
+
+			return ret;
+		}
+
+		bool emulated_;
+		std::vector<std::vector<int> > nodeCpu_;
+	};
+}
+
+#endif
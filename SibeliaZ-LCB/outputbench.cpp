@@ -0,0 +1,118 @@
+#include <thread>
+#include <chrono>
+#include <iomanip>
+
+#include <tclap/CmdLine.h>
+
+#include "blocksfinder.h"
+#include "syntheticgenomes.h"
+
+namespace
+{
+	template<class F>
+	double Measure(F f)
+	{
+		auto start = std::chrono::steady_clock::now();
+		f();
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// The console output of the search and the writers goes to a null stream
+	struct SilentCout
+	{
+		std::streambuf * saved;
+		std::ofstream null;
+
+		SilentCout() : saved(std::cout.rdbuf()), null("/dev/null")
+		{
+			std::cout.rdbuf(null.rdbuf());
+		}
+
+		~SilentCout()
+		{
+			std::cout.rdbuf(saved);
+		}
+	};
+
+	uint64_t FileSize(const std::string & fileName)
+	{
+		std::ifstream in(fileName.c_str(), std::ios::binary | std::ios::ate);
+		return in ? uint64_t(in.tellg()) : 0;
+	}
+}
+
+// Searches synthetic genomes once and times the output the sibeliaz-lcb
+// binary writes for the result: the GFF of GenerateOutput and the block
+// sequences of ListBlocksSequences, the best of several runs each. The
+// output is left in <workdir>/outputbench.
+int main(int argc, char * argv[])
+{
+	try
+	{
+		TCLAP::CmdLine cmd("Benchmark of the SibeliaZ-LCB output on synthetic genomes", ' ', Sibelia::VERSION);
+		TCLAP::ValueArg<unsigned int> genomes("", "genomes", "Number of genomes", false, 8, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> length("", "length", "Length of the ancestor", false, 1000000, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> seed("", "seed", "Seed of the generator", false, 1, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> kvalue("k", "kvalue", "Value of k, odd and at most 31", false, 25, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> minBlockSize("m", "blocksize", "Minimum block size", false, 50, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> maxBranchSize("b", "branchsize", "Maximum branch size", false, 200, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> threads("t", "threads", "Number of threads", false, std::max(1u, std::thread::hardware_concurrency()), "integer", cmd);
+		TCLAP::ValueArg<unsigned int> bundles("", "bundles", "Pack the block sequences into this many files, 0 writes a file per block", false, 0, "integer", cmd);
+		TCLAP::ValueArg<unsigned int> runs("", "runs", "Number of timed runs of each writer", false, 3, "integer", cmd);
+		TCLAP::ValueArg<std::string> workDir("", "workdir", "Directory for the generated files", false, ".", "directory name", cmd);
+		cmd.parse(argc, argv);
+
+		Sibelia::SyntheticGenomes::Options options;
+		options.genomes = genomes.getValue();
+		options.length = length.getValue();
+		options.seed = seed.getValue();
+		std::string fastaFileName = workDir.getValue() + "/bench_genomes.fa";
+		std::string graphFileName = workDir.getValue() + "/bench_graph.cjf";
+		{
+			Sibelia::SyntheticGenomes synthetic(options);
+			synthetic.WriteFasta(fastaFileName);
+			synthetic.WriteJunctions(graphFileName, kvalue.getValue(), threads.getValue());
+		}
+
+		int64_t k = kvalue.getValue();
+		Sibelia::JunctionStorage storage(graphFileName, fastaFileName, k, threads.getValue(), 150, 0);
+		Sibelia::BlocksFinder finder(storage, k);
+		finder.SetBundles(bundles.getValue());
+		{
+			SilentCout silent;
+			finder.FindBlocks(minBlockSize.getValue(), maxBranchSize.getValue(), maxBranchSize.getValue(), 8, 0, threads.getValue(), "/dev/null");
+		}
+
+		std::string outDir = workDir.getValue() + "/outputbench";
+		std::string blocksDir = outDir + "/blocks";
+		Sibelia::CreateOutDirectory(outDir);
+		Sibelia::CreateOutDirectory(blocksDir);
+		double gff = 0;
+		double sequences = 0;
+		for (size_t run = 0; run < std::max(1u, runs.getValue()); run++)
+		{
+			SilentCout silent;
+			double now = Measure([&]() { finder.GenerateOutput(outDir, false); });
+			gff = run == 0 ? now : std::min(gff, now);
+			now = Measure([&]() { finder.ListBlocksSequences(blocksDir); });
+			sequences = run == 0 ? now : std::min(sequences, now);
+		}
+
+		uint64_t gffSize = FileSize(outDir + "/blocks_coords.gff");
+		std::cout << "Genomes: " << options.genomes << " x " << options.length << " bp, blocks: " << finder.GetBlocksFound() << std::endl;
+		std::cout << std::fixed << std::setprecision(3) << "GFF: " << gff << " s (" << std::setprecision(1) << gffSize / gff / (1 << 20) << " MB/s)" << std::endl;
+		std::cout << std::setprecision(3) << "Block sequences, " << threads.getValue() << " threads, " << bundles.getValue() << " bundles: " << sequences << " s" << std::endl;
+	}
+	catch (TCLAP::ArgException & e)
+	{
+		std::cerr << "error: " << e.error() << " for arg " << e.argId() << std::endl;
+		return 1;
+	}
+	catch (std::runtime_error & e)
+	{
+		std::cerr << "error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
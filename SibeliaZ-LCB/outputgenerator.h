@@ -1,9 +1,142 @@
 #ifndef _OUTPUT_GENERATOR_H_
 #define _OUTPUT_GENERATOR_H_
 
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+
 namespace Sibelia
 {
+	// Formats records into a large buffer and hands it to the stream in big
+	// writes, so no line costs a flush, a stringstream or a temporary string
+	class OutputBuffer
+	{
+	public:
+		OutputBuffer(std::ostream & out, size_t capacity = size_t(1) << 20) : out_(out), buffer_(capacity), size_(0), written_(0)
+		{
+
+		}
+
+		~OutputBuffer()
+		{
+			if (size_ > 0)
+			{
+				out_.write(&buffer_[0], size_);
+			}
+		}
+
+		void Flush()
+		{
+			if (size_ > 0)
+			{
+				out_.write(&buffer_[0], size_);
+				written_ += size_;
+				size_ = 0;
+			}
+
+			if (!out_)
+			{
+				throw std::runtime_error("Cannot write the output");
+			}
+		}
+
+		OutputBuffer & Put(char ch)
+		{
+			if (size_ == buffer_.size())
+			{
+				Flush();
+			}
+
+			buffer_[size_++] = ch;
+			return *this;
+		}
+
+		OutputBuffer & Write(const char * data, size_t size)
+		{
+			if (size_ + size > buffer_.size())
+			{
+				Flush();
+				if (size > buffer_.size())
+				{
+					out_.write(data, size);
+					written_ += size;
+					return *this;
+				}
+			}
+
+			memcpy(&buffer_[size_], data, size);
+			size_ += size;
+			return *this;
+		}
+
+		// Bytes handed to the buffer so far, flushed or not
+		uint64_t GetWritten() const
+		{
+			return written_ + size_;
+		}
+
+		OutputBuffer & operator << (char ch)
+		{
+			return Put(ch);
+		}
+
+		OutputBuffer & operator << (const char * str)
+		{
+			return Write(str, strlen(str));
+		}
+
+		OutputBuffer & operator << (const std::string & str)
+		{
+			return Write(str.data(), str.size());
+		}
+
+		OutputBuffer & operator << (uint64_t x)
+		{
+			char digit[20];
+			char * end = digit + sizeof(digit);
+			char * now = end;
+			do
+			{
+				*--now = char('0' + x % 10);
+				x /= 10;
+			} while (x > 0);
+
+			return Write(now, end - now);
+		}
+
+		OutputBuffer & operator << (int64_t x)
+		{
+			if (x < 0)
+			{
+				Put('-');
+				return *this << uint64_t(0) - uint64_t(x);
+			}
+
+			return *this << uint64_t(x);
+		}
+
+		OutputBuffer & operator << (uint32_t x)
+		{
+			return *this << uint64_t(x);
+		}
+
+		OutputBuffer & operator << (int32_t x)
+		{
+			return *this << int64_t(x);
+		}
+
+	private:
+		OutputBuffer(const OutputBuffer &);
+		OutputBuffer & operator = (const OutputBuffer &);
 
+		std::ostream & out_;
+		std::vector<char> buffer_;
+		size_t size_;
+		uint64_t written_;
+	};
 }
 
-#endif
\ No newline at end of file
+#endif
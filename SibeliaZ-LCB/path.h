@@ -5,6 +5,7 @@
 #include <cassert>
 #include <algorithm>
 #include "distancekeeper.h"
+#include "searchcounters.h"
 
 
 #include <tbb/mutex.h>
@@ -18,7 +19,7 @@ namespace Sibelia
 	{
 		int32_t block;
 		int32_t instance;
-		Assignment()
+		Assignment() : block(0), instance(0)
 		{
 
 		}
@@ -413,6 +414,90 @@ namespace Sibelia
 			return true;
 		}
 
+		// Calls f with the occurrences of a repeat vertex Compatible can accept
+		// next to the instances: within the branch size past the back of each
+		// one if forward, or before its front otherwise, and the occurrence
+		// after a longer edge. A repeat vertex only extends instances, so the
+		// instance list doesn't change meanwhile. The occurrences are searched
+		// by the junction start, which GetPosition shifts by k on the reverse
+		// strand, so the window is built from the absolute positions.
+		template<class F>
+		void ForEachNearOccurrence(int64_t vertex, bool forward, F f) const
+		{
+			for (size_t i = 0; i < allInstance_.size(); i++)
+			{
+				auto end = forward ? allInstance_[i]->Back() : allInstance_[i]->Front();
+				int64_t pos = end.GetAbsolutePosition();
+				if (forward == end.IsPositiveStrand())
+				{
+					ForEachOccurrence(vertex, end.GetChrId(), pos, pos + maxBranchSize_, f);
+				}
+				else
+				{
+					ForEachOccurrence(vertex, end.GetChrId(), max(int64_t(0), pos - maxBranchSize_), pos, f);
+				}
+
+				auto next = forward ? end.Next() : end.Prev();
+				if (next.Valid() && next.GetVertexId() == vertex && abs(next.GetAbsolutePosition() - pos) > maxBranchSize_)
+				{
+					ForEachOccurrence(vertex, end.GetChrId(), next.GetAbsolutePosition(), next.GetAbsolutePosition(), f);
+				}
+			}
+		}
+
+		// Whether pushing e onto a repeat vertex would offer every occurrence a
+		// full scan would extend an instance with, on either strand. Checked by
+		// the benchmark, the path is left as it was.
+		bool NearOccurrencesComplete(const Edge & e, bool forward)
+		{
+			bool ret = true;
+			int64_t vertex = forward ? e.GetEndVertex() : e.GetStartVertex();
+			distanceKeeper_.Set(vertex, int(forward ? rightBodyFlank_ + e.GetLength() : leftBodyFlank_ - e.GetLength()));
+			std::set<std::pair<int64_t, int64_t> > offered;
+			ForEachNearOccurrence(vertex, forward, [&offered](const JunctionStorage::JunctionIterator & it) { offered.insert(std::make_pair(int64_t(it.GetChrId()), int64_t(it.GetIndex()))); });
+			for (JunctionStorage::JunctionIterator nowIt(vertex); nowIt.Valid() && ret; ++nowIt)
+			{
+				if (nowIt.IsUsed() || offered.count(std::make_pair(int64_t(nowIt.GetChrId()), int64_t(nowIt.GetIndex()))) > 0)
+				{
+					continue;
+				}
+
+				auto & instanceSet = instance_[nowIt.GetChrId()];
+				auto inst = instanceSet.upper_bound(Instance(nowIt.SequentialIterator(), 0));
+				if (inst != instanceSet.end() && inst->Within(nowIt))
+				{
+					continue;
+				}
+
+				bool before = forward == nowIt.IsPositiveStrand();
+				if (before ? inst == instanceSet.begin() : inst == instanceSet.end())
+				{
+					continue;
+				}
+
+				if (before)
+				{
+					--inst;
+				}
+
+				ret = !(forward ? Compatible(inst->Back(), nowIt.SequentialIterator(), e) : Compatible(nowIt.SequentialIterator(), inst->Front(), e));
+			}
+
+			distanceKeeper_.Unset(vertex);
+			return ret;
+		}
+
+		template<class F>
+		void ForEachOccurrence(int64_t vertex, uint64_t chrId, uint64_t start, uint64_t end, F f) const
+		{
+			SIBELIAZ_COUNT(REPEAT_LOOKUPS, 1);
+			std::pair<size_t, size_t> range = storage_->OccurrenceRange(vertex, chrId, start, end);
+			for (size_t i = range.first; i < range.second; i++)
+			{
+				f(JunctionStorage::JunctionIterator(vertex) + i);
+			}
+		}
+
 		class PointPushFrontWorker
 		{
 		public:
@@ -429,47 +514,59 @@ namespace Sibelia
 
 			void operator()() const
 			{
+				if (path->storage_->IsRepeat(vertex))
+				{
+					path->ForEachNearOccurrence(vertex, false, [this](const JunctionStorage::JunctionIterator & nowIt) { Push(nowIt, false); });
+					return;
+				}
+
 				for (JunctionStorage::JunctionIterator nowIt(vertex); nowIt.Valid() && !failFlag; nowIt++)
 				{
-					bool newInstance = true;
-					if (!nowIt.IsUsed())
+					Push(nowIt, true);
+				}
+			}
+
+			void Push(const JunctionStorage::JunctionIterator & nowIt, bool create) const
+			{
+				bool newInstance = true;
+				if (!nowIt.IsUsed())
+				{
+					auto & instanceSet = path->instance_[nowIt.GetChrId()];
+					auto inst = instanceSet.upper_bound(Instance(nowIt.SequentialIterator(), 0));
+					if (inst != instanceSet.end() && inst->Within(nowIt))
 					{
-						auto & instanceSet = path->instance_[nowIt.GetChrId()];
-						auto inst = instanceSet.upper_bound(Instance(nowIt.SequentialIterator(), 0));
-						if (inst != instanceSet.end() && inst->Within(nowIt))
-						{
-							continue;
-						}
+						return;
+					}
 
-						if (nowIt.IsPositiveStrand())
+					if (nowIt.IsPositiveStrand())
+					{
+						if (inst != instanceSet.end() && path->Compatible(nowIt.SequentialIterator(), inst->Front(), e))
 						{
-							if (inst != instanceSet.end() && path->Compatible(nowIt.SequentialIterator(), inst->Front(), e))
-							{
-								newInstance = false;
-							}
+							newInstance = false;
 						}
-						else
+					}
+					else
+					{
+						if (inst != instanceSet.begin() && path->Compatible(nowIt.SequentialIterator(), (--inst)->Front(), e))
 						{
-							if (inst != instanceSet.begin() && path->Compatible(nowIt.SequentialIterator(), (--inst)->Front(), e))
-							{
-								newInstance = false;
-							}
+							newInstance = false;
 						}
+					}
 
-						if (!newInstance && inst->Front().GetVertexId() != vertex)
-						{
-							bool prevGoodInstance = path->IsGoodInstance(*inst);
-							const_cast<Instance&>(*inst).ChangeFront(nowIt.SequentialIterator(), distance);
-							if (!prevGoodInstance && path->IsGoodInstance(*inst))
-							{
-								path->goodInstance_.push_back(inst);
-							}
-						}
-						else
+					if (!newInstance && inst->Front().GetVertexId() != vertex)
+					{
+						bool prevGoodInstance = path->IsGoodInstance(*inst);
+						const_cast<Instance&>(*inst).ChangeFront(nowIt.SequentialIterator(), distance);
+						if (!prevGoodInstance && path->IsGoodInstance(*inst))
 						{
-							path->allInstance_.push_back(instanceSet.insert(Instance(nowIt.SequentialIterator(), distance)));
+							path->goodInstance_.push_back(inst);
 						}
 					}
+					else if (create)
+					{
+						SIBELIAZ_COUNT(INSTANCES_CREATED, 1);
+						path->allInstance_.push_back(instanceSet.insert(Instance(nowIt.SequentialIterator(), distance)));
+					}
 				}
 			}
 
@@ -491,47 +588,59 @@ namespace Sibelia
 
 			void operator()() const
 			{
+				if (path->storage_->IsRepeat(vertex))
+				{
+					path->ForEachNearOccurrence(vertex, true, [this](const JunctionStorage::JunctionIterator & nowIt) { Push(nowIt, false); });
+					return;
+				}
+
 				for (JunctionStorage::JunctionIterator nowIt(vertex); nowIt.Valid() && !failFlag; nowIt++)
 				{
-					bool newInstance = true;
-					if (!nowIt.IsUsed())
+					Push(nowIt, true);
+				}
+			}
+
+			void Push(const JunctionStorage::JunctionIterator & nowIt, bool create) const
+			{
+				bool newInstance = true;
+				if (!nowIt.IsUsed())
+				{
+					auto & instanceSet = path->instance_[nowIt.GetChrId()];
+					auto inst = instanceSet.upper_bound(Instance(nowIt.SequentialIterator(), 0));
+					if (inst != instanceSet.end() && inst->Within(nowIt))
 					{
-						auto & instanceSet = path->instance_[nowIt.GetChrId()];
-						auto inst = instanceSet.upper_bound(Instance(nowIt.SequentialIterator(), 0));
-						if (inst != instanceSet.end() && inst->Within(nowIt))
-						{
-							continue;
-						}
+						return;
+					}
 
-						if (nowIt.IsPositiveStrand())
+					if (nowIt.IsPositiveStrand())
+					{
+						if (inst != instanceSet.begin() && path->Compatible((--inst)->Back(), nowIt.SequentialIterator(), e))
 						{
-							if (inst != instanceSet.begin() && path->Compatible((--inst)->Back(), nowIt.SequentialIterator(), e))
-							{
-								newInstance = false;
-							}
+							newInstance = false;
 						}
-						else
+					}
+					else
+					{
+						if (inst != instanceSet.end() && path->Compatible(inst->Back(), nowIt.SequentialIterator(), e))
 						{
-							if (inst != instanceSet.end() && path->Compatible(inst->Back(), nowIt.SequentialIterator(), e))
-							{
-								newInstance = false;
-							}
+							newInstance = false;
 						}
+					}
 
-						if (!newInstance && inst->Back().GetVertexId() != vertex)
-						{
-							bool prevGoodInstance = path->IsGoodInstance(*inst);
-							const_cast<Instance&>(*inst).ChangeBack(nowIt.SequentialIterator(), distance);
-							if (!prevGoodInstance && path->IsGoodInstance(*inst))
-							{
-								path->goodInstance_.push_back(inst);
-							}
-						}
-						else
+					if (!newInstance && inst->Back().GetVertexId() != vertex)
+					{
+						bool prevGoodInstance = path->IsGoodInstance(*inst);
+						const_cast<Instance&>(*inst).ChangeBack(nowIt.SequentialIterator(), distance);
+						if (!prevGoodInstance && path->IsGoodInstance(*inst))
 						{
-							path->allInstance_.push_back(instanceSet.insert(Instance(nowIt.SequentialIterator(), distance)));
+							path->goodInstance_.push_back(inst);
 						}
 					}
+					else if (create)
+					{
+						SIBELIAZ_COUNT(INSTANCES_CREATED, 1);
+						path->allInstance_.push_back(instanceSet.insert(Instance(nowIt.SequentialIterator(), distance)));
+					}
 				}
 			}
 
@@ -539,6 +648,7 @@ namespace Sibelia
 
 		bool PointPushBack(const Edge & e)
 		{
+			SIBELIAZ_COUNT(PUSH_BACK_CALLS, 1);
 			int64_t vertex = e.GetEndVertex();
 			if (distanceKeeper_.IsSet(vertex))
 			{
@@ -558,6 +668,7 @@ namespace Sibelia
 
 		bool PointPushFront(const Edge & e)
 		{
+			SIBELIAZ_COUNT(PUSH_FRONT_CALLS, 1);
 			int64_t vertex = e.GetStartVertex();
 			if (distanceKeeper_.IsSet(vertex))
 			{
@@ -576,6 +687,7 @@ namespace Sibelia
 
 		int64_t Score(bool final = false) const
 		{
+			SIBELIAZ_COUNT(SCORE_EVALUATIONS, 1);
 			int64_t ret = 0;
 			int64_t multiplier = goodInstance_.size();
 			for (auto & instanceIt : goodInstance_)
@@ -601,6 +713,33 @@ namespace Sibelia
 			return ret;
 		}
 
+		// Optimistic bound on the score reachable if no instance grows by more than
+		// reach bp. Only one side of the path moves at a time, so the flank penalty
+		// of the other side is already fixed. Instances created later start from
+		// a single point and can't become good unless reach >= minBlockSize_.
+		int64_t ScoreUpperBound(int64_t reach, bool forward) const
+		{
+			int64_t ret = 0;
+			for (auto & instanceIt : allInstance_)
+			{
+				int64_t length = instanceIt->RealLength() + reach;
+				int64_t penalty = forward ? LeftDistance() + instanceIt->LeftFlankDistance() : RightDistance() - instanceIt->RightFlankDistance();
+				if (penalty >= maxFlankingSize_)
+				{
+					if (IsGoodInstance(*instanceIt))
+					{
+						return 0;
+					}
+				}
+				else if (length >= minBlockSize_)
+				{
+					ret += max(int64_t(0), length - penalty * penalty);
+				}
+			}
+
+			return reach >= minBlockSize_ ? INT64_MAX : ret;
+		}
+
 		int64_t GoodInstances() const
 		{
 			return goodInstance_.size();
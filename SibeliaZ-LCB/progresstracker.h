@@ -0,0 +1,156 @@
+#ifndef _PROGRESS_TRACKER_H_
+#define _PROGRESS_TRACKER_H_
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <condition_variable>
+
+namespace Sibelia
+{
+	// Progress of the search. Workers only bump relaxed atomics; a reporter
+	// thread draws the bar of DOTS dots and, if a status file is given,
+	// rewrites it every interval seconds with one JSON object: the state
+	// (search, done or failed), seeds done and total, blocks found, positions marked used and total, bp covered and
+	// total, elapsed seconds, seeds per second and the ETA.
+	class ProgressTracker
+	{
+	public:
+		static const size_t DOTS = 50;
+
+		ProgressTracker() : seedsDone_(0), blocks_(0), positionsUsed_(0), bpCovered_(0)
+		{
+
+		}
+
+		~ProgressTracker()
+		{
+			Stop();
+		}
+
+		// The initial counters account for blocks restored from a saved run
+		void Start(uint64_t seedsTotal, uint64_t positionsTotal, uint64_t bpTotal, int64_t blocks, uint64_t positionsUsed, uint64_t bpCovered,
+			const std::string & statusFileName, size_t interval, bool bar = true)
+		{
+			seedsTotal_ = seedsTotal;
+			positionsTotal_ = positionsTotal;
+			bpTotal_ = bpTotal;
+			seedsDone_ = 0;
+			blocks_ = blocks;
+			positionsUsed_ = positionsUsed;
+			bpCovered_ = bpCovered;
+			dots_ = bar ? 0 : size_t(DOTS);
+			bar_ = bar;
+			done_ = false;
+			failed_ = false;
+			statusFileName_ = statusFileName;
+			interval_ = interval;
+			start_ = std::chrono::steady_clock::now();
+			if (bar_)
+			{
+				std::cout << '[' << std::flush;
+			}
+
+			reporter_ = std::thread(&ProgressTracker::Report, this);
+		}
+
+		// A search stopped by an error leaves the status file "failed"
+		void Stop(bool failed = false)
+		{
+			if (reporter_.joinable())
+			{
+				{
+					std::lock_guard<std::mutex> lock(mutex_);
+					done_ = true;
+					failed_ = failed;
+				}
+
+				wake_.notify_one();
+				reporter_.join();
+				if (bar_)
+				{
+					std::cout << ']' << std::endl;
+				}
+			}
+		}
+
+		void SeedDone()
+		{
+			seedsDone_.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void BlockFound(uint64_t positions, uint64_t bp)
+		{
+			blocks_.fetch_add(1, std::memory_order_relaxed);
+			positionsUsed_.fetch_add(positions, std::memory_order_relaxed);
+			bpCovered_.fetch_add(bp, std::memory_order_relaxed);
+		}
+
+	private:
+		void Report()
+		{
+			auto lastWrite = start_;
+			std::unique_lock<std::mutex> lock(mutex_);
+			for (bool last = false; !last;)
+			{
+				last = wake_.wait_for(lock, std::chrono::milliseconds(100), [this]() { return done_; });
+				size_t dots = seedsTotal_ > 0 && (!last || failed_) ? size_t(seedsDone_.load(std::memory_order_relaxed) * DOTS / seedsTotal_) : size_t(DOTS);
+				for (; dots_ < std::min(dots, size_t(DOTS)); dots_++)
+				{
+					std::cout << '.' << std::flush;
+				}
+
+				auto now = std::chrono::steady_clock::now();
+				if (!statusFileName_.empty() && (last || now - lastWrite >= std::chrono::seconds(interval_)))
+				{
+					WriteStatus(last, std::chrono::duration<double>(now - start_).count());
+					lastWrite = now;
+				}
+			}
+		}
+
+		// Written aside and renamed, so a reader never sees a partial status
+		void WriteStatus(bool done, double elapsed) const
+		{
+			uint64_t seedsDone = seedsDone_.load(std::memory_order_relaxed);
+			double rate = elapsed > 0 ? seedsDone / elapsed : 0;
+			double eta = done && !failed_ ? 0 : (rate > 0 && !done ? (seedsTotal_ - seedsDone) / rate : -1);
+			std::string tmpFileName = statusFileName_ + ".tmp";
+			{
+				std::ofstream out(tmpFileName.c_str());
+				out << "{\"state\": \"" << (done ? (failed_ ? "failed" : "done") : "search") << "\", \"seeds_done\": " << seedsDone << ", \"seeds_total\": " << seedsTotal_ <<
+					", \"blocks\": " << blocks_.load(std::memory_order_relaxed) << ", \"positions_used\": " << positionsUsed_.load(std::memory_order_relaxed) <<
+					", \"positions_total\": " << positionsTotal_ << ", \"bp_covered\": " << bpCovered_.load(std::memory_order_relaxed) << ", \"bp_total\": " << bpTotal_ <<
+					", \"elapsed_s\": " << elapsed << ", \"seeds_per_s\": " << rate << ", \"eta_s\": " << eta << "}\n";
+			}
+
+			std::rename(tmpFileName.c_str(), statusFileName_.c_str());
+		}
+
+		uint64_t seedsTotal_;
+		uint64_t positionsTotal_;
+		uint64_t bpTotal_;
+		std::atomic<uint64_t> seedsDone_;
+		std::atomic<int64_t> blocks_;
+		std::atomic<uint64_t> positionsUsed_;
+		std::atomic<uint64_t> bpCovered_;
+		size_t dots_;
+		bool bar_;
+		bool done_;
+		bool failed_;
+		std::string statusFileName_;
+		size_t interval_;
+		std::chrono::steady_clock::time_point start_;
+		std::mutex mutex_;
+		std::condition_variable wake_;
+		std::thread reporter_;
+	};
+}
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef _REGIONS_H_
+#define _REGIONS_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <stdexcept>
+#include <algorithm>
+
+#include "junctionstorage.h"
+
+namespace Sibelia
+{
+	// Regions of the genomes read from a BED file: a chromosome, a 0-based
+	// start and an exclusive end per line, further columns ignored. The
+	// chromosome is the FASTA header or its first word. Overlapping regions
+	// of a chromosome are merged and kept sorted.
+	class RegionSet
+	{
+	public:
+		typedef std::pair<uint64_t, uint64_t> Interval;
+
+		void Load(const std::string & fileName, const JunctionStorage & storage)
+		{
+			std::map<std::string, size_t> chrId;
+			for (int64_t chr = storage.GetChrNumber() - 1; chr >= 0; chr--)
+			{
+				const std::string & description = storage.GetChrDescription(chr);
+				chrId[description.substr(0, description.find_first_of(" \t"))] = size_t(chr);
+				chrId[description] = size_t(chr);
+			}
+
+			std::ifstream in(fileName.c_str());
+			if (!in)
+			{
+				throw std::runtime_error(("Cannot open the regions file " + fileName).c_str());
+			}
+
+			region_.assign(storage.GetChrNumber(), std::vector<Interval>());
+			std::string line;
+			for (size_t number = 1; std::getline(in, line); number++)
+			{
+				if (line.empty() || line[0] == '#' || line.compare(0, 5, "track") == 0 || line.compare(0, 7, "browser") == 0)
+				{
+					continue;
+				}
+
+				std::string name;
+				Interval now;
+				std::stringstream ss(line);
+				if (!std::getline(ss, name, '\t') || !(ss >> now.first >> now.second) || now.first > now.second)
+				{
+					throw std::runtime_error(("Malformed line " + std::to_string(number) + " of " + fileName).c_str());
+				}
+
+				auto it = chrId.find(name);
+				if (it == chrId.end())
+				{
+					throw std::runtime_error(("Unknown sequence " + name + " in " + fileName).c_str());
+				}
+
+				region_[it->second].push_back(now);
+			}
+
+			for (std::vector<Interval> & chr : region_)
+			{
+				std::sort(chr.begin(), chr.end());
+				size_t merged = 0;
+				for (size_t i = 0; i < chr.size(); i++)
+				{
+					if (merged > 0 && chr[i].first <= chr[merged - 1].second)
+					{
+						chr[merged - 1].second = std::max(chr[merged - 1].second, chr[i].second);
+					}
+					else
+					{
+						chr[merged++] = chr[i];
+					}
+				}
+
+				chr.resize(merged);
+			}
+		}
+
+		const std::vector<Interval> & GetRegions(size_t chr) const
+		{
+			return region_[chr];
+		}
+
+		bool Intersects(size_t chr, uint64_t start, uint64_t end) const
+		{
+			const std::vector<Interval> & now = region_[chr];
+			auto it = std::upper_bound(now.begin(), now.end(), start, [](uint64_t pos, const Interval & region) { return pos < region.second; });
+			return it != now.end() && it->first < end;
+		}
+
+	private:
+		std::vector<std::vector<Interval> > region_;
+	};
+}
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef _RUN_REPORT_H_
+#define _RUN_REPORT_H_
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <utility>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+namespace Sibelia
+{
+	// Wall and CPU time of the phases of a run, the peak RSS after each of
+	// them, the sizes of the main arrays and the search counters, if they are
+	// compiled in, written as JSON. Utilization is
+	// the CPU time over the wall time times the threads given to the phase.
+	class RunReport
+	{
+	public:
+		RunReport() : start_(std::chrono::steady_clock::now()), startCpu_(CpuTime())
+		{
+
+		}
+
+		// Measures the enclosing scope, does nothing if report is 0
+		class Phase
+		{
+		public:
+			Phase(RunReport * report, const std::string & name, int64_t threads = 1) : report_(report), name_(name), threads_(threads),
+				start_(std::chrono::steady_clock::now()), startCpu_(CpuTime())
+			{
+
+			}
+
+			~Phase()
+			{
+				if (report_ != 0)
+				{
+					Record record;
+					record.name = name_;
+					record.threads = threads_;
+					record.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+					record.cpu = CpuTime() - startCpu_;
+					record.peakRss = PeakRss();
+					report_->phase_.push_back(record);
+				}
+			}
+
+		private:
+			Phase(const Phase &);
+			Phase & operator = (const Phase &);
+
+			RunReport * report_;
+			std::string name_;
+			int64_t threads_;
+			std::chrono::steady_clock::time_point start_;
+			double startCpu_;
+		};
+
+		void SetArray(const std::string & name, uint64_t elements, uint64_t bytes)
+		{
+			Array array;
+			array.name = name;
+			array.elements = elements;
+			array.bytes = bytes;
+			array_.push_back(array);
+		}
+
+		void SetCounter(const std::string & name, uint64_t value)
+		{
+			counter_.push_back(std::make_pair(name, value));
+		}
+
+		void Write(const std::string & fileName, int64_t threads) const
+		{
+			std::ofstream out(fileName.c_str());
+			double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+			out << "{\n\t\"threads\": " << threads << ",\n\t\"wall_s\": " << wall << ",\n\t\"cpu_s\": " << CpuTime() - startCpu_ <<
+				",\n\t\"peak_rss_mb\": " << PeakRss() / double(1 << 20) << ",\n\t\"phases\": [";
+			for (size_t i = 0; i < phase_.size(); i++)
+			{
+				const Record & now = phase_[i];
+				out << (i > 0 ? "," : "") << "\n\t\t{\"name\": \"" << now.name << "\", \"threads\": " << now.threads << ", \"wall_s\": " << now.wall <<
+					", \"cpu_s\": " << now.cpu << ", \"utilization\": " << (now.wall > 0 ? now.cpu / (now.wall * now.threads) : 0) <<
+					", \"peak_rss_mb\": " << now.peakRss / double(1 << 20) << "}";
+			}
+
+			out << "\n\t],\n\t\"arrays\": [";
+			for (size_t i = 0; i < array_.size(); i++)
+			{
+				out << (i > 0 ? "," : "") << "\n\t\t{\"name\": \"" << array_[i].name << "\", \"elements\": " << array_[i].elements << ", \"bytes\": " << array_[i].bytes << "}";
+			}
+
+			out << "\n\t],\n\t\"counters\": {";
+			for (size_t i = 0; i < counter_.size(); i++)
+			{
+				out << (i > 0 ? "," : "") << "\n\t\t\"" << counter_[i].first << "\": " << counter_[i].second;
+			}
+
+			out << (counter_.empty() ? "}" : "\n\t}") << "\n}\n";
+			if (!out)
+			{
+				throw std::runtime_error(("Cannot write the run report " + fileName).c_str());
+			}
+		}
+
+		static double CpuTime()
+		{
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+		}
+
+		// In bytes, Linux reports ru_maxrss in kilobytes
+		static uint64_t PeakRss()
+		{
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			return uint64_t(usage.ru_maxrss) << 10;
+		}
+
+	private:
+		struct Record
+		{
+			std::string name;
+			int64_t threads;
+			double wall;
+			double cpu;
+			uint64_t peakRss;
+		};
+
+		struct Array
+		{
+			std::string name;
+			uint64_t elements;
+			uint64_t bytes;
+		};
+
+		std::chrono::steady_clock::time_point start_;
+		double startCpu_;
+		std::vector<Record> phase_;
+		std::vector<Array> array_;
+		std::vector<std::pair<std::string, uint64_t> > counter_;
+	};
+}
+
+#endif
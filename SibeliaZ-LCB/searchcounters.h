@@ -0,0 +1,121 @@
+#ifndef _SEARCH_COUNTERS_H_
+#define _SEARCH_COUNTERS_H_
+
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+// Counts the hot paths of the block search when compiled with
+// SIBELIAZ_COUNTERS defined, otherwise SIBELIAZ_COUNT compiles to nothing
+#ifdef SIBELIAZ_COUNTERS
+#define SIBELIAZ_COUNT(counter, n) (Sibelia::SearchCounters::Local().value[Sibelia::SearchCounters::counter] += (n))
+#else
+#define SIBELIAZ_COUNT(counter, n) ((void)0)
+#endif
+
+namespace Sibelia
+{
+	// Every thread adds to its own counters without synchronization. They are
+	// registered on the first use by the thread and summed by Collect once the
+	// workers are done.
+	class SearchCounters
+	{
+	public:
+		enum Counter
+		{
+			SEEDS_PROCESSED,
+			SEEDS_SKIPPED,
+			PUSH_BACK_CALLS,
+			PUSH_FRONT_CALLS,
+			INSTANCES_CREATED,
+			LOOKAHEAD_SCANNED,
+			SCORE_EVALUATIONS,
+			FINALIZE_ATTEMPTS,
+			FINALIZE_SUCCESSES,
+			STRIPE_ACQUISITIONS,
+			STRIPE_WAITS,
+			REPEAT_LOOKUPS,
+			COUNTERS_NUMBER
+		};
+
+		struct Values
+		{
+			uint64_t value[COUNTERS_NUMBER];
+		};
+
+		static const char * Name(size_t counter)
+		{
+			static const char * name[COUNTERS_NUMBER] =
+			{
+				"seeds_processed",
+				"seeds_skipped",
+				"push_back_calls",
+				"push_front_calls",
+				"instances_created",
+				"lookahead_scanned",
+				"score_evaluations",
+				"finalize_attempts",
+				"finalize_successes",
+				"stripe_acquisitions",
+				"stripe_waits",
+				"repeat_lookups"
+			};
+
+			return name[counter];
+		}
+
+		// The counters of a thread live as long as the process, since TBB may
+		// keep its workers until exit
+		static Values & Local()
+		{
+			static thread_local Values * local = 0;
+			if (local == 0)
+			{
+				local = new Values();
+				std::lock_guard<std::mutex> lock(Mutex());
+				Registry().push_back(local);
+			}
+
+			return *local;
+		}
+
+		static void Reset()
+		{
+			std::lock_guard<std::mutex> lock(Mutex());
+			for (Values * now : Registry())
+			{
+				*now = Values();
+			}
+		}
+
+		static Values Collect()
+		{
+			Values ret = Values();
+			std::lock_guard<std::mutex> lock(Mutex());
+			for (Values * now : Registry())
+			{
+				for (size_t i = 0; i < COUNTERS_NUMBER; i++)
+				{
+					ret.value[i] += now->value[i];
+				}
+			}
+
+			return ret;
+		}
+
+	private:
+		static std::mutex & Mutex()
+		{
+			static std::mutex mutex;
+			return mutex;
+		}
+
+		static std::vector<Values*> & Registry()
+		{
+			static std::vector<Values*> registry;
+			return registry;
+		}
+	};
+}
+
+#endif
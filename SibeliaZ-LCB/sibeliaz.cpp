@@ -1,5 +1,6 @@
 #include <tclap/CmdLine.h>
 
+#include "lcbserver.h"
 #include "blocksfinder.h"
 
 size_t Atoi(const char * str)
@@ -82,11 +83,19 @@ int main(int argc, char * argv[])
 			"integer",
 			cmd);
 
+		TCLAP::ValueArg<unsigned int> repeatAbundance("",
+			"repeat-abundance",
+			"Keep junctions with abundance from --abundance up to this one as repeats, which only extend blocks seeded elsewhere",
+			false,
+			0,
+			"integer",
+			cmd);
+
 		TCLAP::ValueArg<std::string> inFileName("",
 			"graph",
-			"Binary file containing the graph",
-			true,
-			"de_bruijn.bin",
+			"Binary file containing the graph, - to read it from stdin",
+			false,
+			"",
 			"file name",
 			cmd);
 
@@ -112,19 +121,342 @@ int main(int argc, char * argv[])
 			cmd,
 			false);
 
+		TCLAP::SwitchArg noSort("",
+			"nosort",
+			"Write the blocks coordinates in genome order instead of sorting them by id",
+			cmd,
+			false);
+
+		TCLAP::ValueArg<unsigned int> bundles("",
+			"bundles",
+			"Pack the blocks sequences into this many multi-FASTA files with an index",
+			false,
+			0,
+			"integer",
+			cmd);
+
+		TCLAP::SwitchArg align("",
+			"align",
+			"Align the blocks with spoa and write them to alignment.maf",
+			cmd,
+			false);
+
+		TCLAP::ValueArg<unsigned int> alignThreads("",
+			"align-threads",
+			"Number of threads for the alignment, the same as --threads if 0",
+			false,
+			0,
+			"integer",
+			cmd);
+
+		TCLAP::ValueArg<unsigned int> alignMemory("",
+			"align-memory",
+			"Memory budget for the alignment in megabytes, blocks estimated to need more are not aligned, 0 means no limit",
+			false,
+			0,
+			"integer",
+			cmd);
+
+		TCLAP::ValueArg<unsigned int> anchorLength("",
+			"align-anchored",
+			"Align blocks with a copy of at least this length piecewise between the junctions shared by all copies, 0 means never",
+			false,
+			0,
+			"integer",
+			cmd);
+
+		TCLAP::SwitchArg compressMaf("",
+			"maf-bgzf",
+			"Write the alignment BGZF-compressed to alignment.maf.gz",
+			cmd,
+			false);
+
+		TCLAP::SwitchArg graphStream("",
+			"graph-stream",
+			"Read the graph only once and keep it in memory, so the graph file may be a pipe written by twopaco; implied by --graph -",
+			cmd,
+			false);
+
+		TCLAP::SwitchArg buildGraph("",
+			"build-graph",
+			"Find the junctions of the genomes in memory instead of reading a graph, for small inputs and k up to 31",
+			cmd,
+			false);
+
+		TCLAP::ValueArg<std::string> regionsFileName("",
+			"regions",
+			"BED file of regions: only vertices inside them seed the search and only blocks intersecting them are output",
+			false,
+			"",
+			"file name",
+			cmd);
+
+		TCLAP::SwitchArg prune("",
+			"prune",
+			"Abandon seed extensions that cannot reach a positive score",
+			cmd,
+			false);
+
+		TCLAP::SwitchArg numa("",
+			"numa",
+			"Partition the storage and the search over NUMA nodes",
+			cmd,
+			false);
+
+		TCLAP::ValueArg<unsigned int> numaNodes("",
+			"numa-nodes",
+			"Emulate this many NUMA nodes instead of the detected ones",
+			false,
+			0,
+			"integer",
+			cmd);
+
+		TCLAP::ValueArg<unsigned int> partitions("",
+			"partitions",
+			"Number of processes sharing the seeds",
+			false,
+			1,
+			"integer",
+			cmd);
+
+		TCLAP::ValueArg<unsigned int> partition("",
+			"partition",
+			"Index of the seed partition searched by this process",
+			false,
+			0,
+			"integer",
+			cmd);
+
+		TCLAP::ValueArg<std::string> usedMapFileName("",
+			"used-map",
+			"File with the used positions shared by all processes of a partitioned run, new for each run",
+			false,
+			"",
+			"file name",
+			cmd);
+
+		TCLAP::ValueArg<std::string> saveIndexFileName("",
+			"save-index",
+			"Save the genomes, junctions and blocks of this run so genomes can be added later",
+			false,
+			"",
+			"file name",
+			cmd);
+
+		TCLAP::ValueArg<std::string> loadIndexFileName("",
+			"load-index",
+			"Add the genomes of --fasta to a saved run; --graph then holds the junctions of the new genomes alone",
+			false,
+			"",
+			"file name",
+			cmd);
+
+		TCLAP::ValueArg<std::string> checkpointFileName("",
+			"checkpoint",
+			"Periodically save the state of the search to this file",
+			false,
+			"",
+			"file name",
+			cmd);
+
+		TCLAP::ValueArg<unsigned int> checkpointInterval("",
+			"checkpoint-interval",
+			"Seconds between two checkpoints",
+			false,
+			1800,
+			"integer",
+			cmd);
+
+		TCLAP::SwitchArg resume("",
+			"resume",
+			"Continue the search from the checkpoint if there is one, not with a shared used map",
+			cmd,
+			false);
+
+		TCLAP::ValueArg<std::string> statusFileName("",
+			"status",
+			"Periodically write the progress of the search to this file as JSON",
+			false,
+			"",
+			"file name",
+			cmd);
+
+		TCLAP::ValueArg<unsigned int> statusInterval("",
+			"status-interval",
+			"Seconds between two status updates",
+			false,
+			10,
+			"integer",
+			cmd);
+
+		TCLAP::SwitchArg server("",
+			"server",
+			"Keep the graph loaded and run a search for every JSON request line read from stdin, see lcbserver.h",
+			cmd,
+			false);
+
+		TCLAP::ValueArg<std::string> socketFileName("",
+			"socket",
+			"Keep the graph loaded and answer search requests sent to this Unix socket",
+			false,
+			"",
+			"file name",
+			cmd);
 
 		cmd.parse(argc, argv);
+		bool serve = server.getValue() || !socketFileName.getValue().empty();
+		if (serve && (!usedMapFileName.getValue().empty() || !checkpointFileName.getValue().empty() || !saveIndexFileName.getValue().empty()))
+		{
+			throw TCLAP::ArgException("cannot be used with a shared used map, checkpoints or saving the index", "server");
+		}
+
+		if (server.getValue() && socketFileName.getValue().empty() && inFileName.getValue() == "-")
+		{
+			throw TCLAP::ArgException("reads the requests from stdin, which cannot hold the graph as well", "server");
+		}
+
+		// Answers go to stdout, so the console output of a stdin server goes to stderr
+		std::ostream answer(std::cout.rdbuf());
+		if (server.getValue() && socketFileName.getValue().empty())
+		{
+			std::cout.rdbuf(std::cerr.rdbuf());
+		}
+
+		if (inFileName.getValue().empty() != buildGraph.getValue())
+		{
+			throw TCLAP::ArgException("either a graph or --build-graph is required", "graph");
+		}
+
+		if (buildGraph.getValue() && !loadIndexFileName.getValue().empty())
+		{
+			throw TCLAP::ArgException("an incremental run needs the graph of the new genomes", "build-graph");
+		}
+
+		if (partition.getValue() >= partitions.getValue())
+		{
+			throw TCLAP::ArgException("must be less than the number of partitions", "partition");
+		}
+
+		if (partitions.getValue() > 1 && usedMapFileName.getValue().empty())
+		{
+			throw TCLAP::ArgException("a partitioned run needs a shared used map", "used-map");
+		}
+
+		if (partitions.getValue() > 1 && bundles.getValue() > 0)
+		{
+			throw TCLAP::ArgException("the bundles of partitions cannot be merged", "bundles");
+		}
+
+		if (resume.getValue() && checkpointFileName.getValue().empty())
+		{
+			throw TCLAP::ArgException("needs a checkpoint file", "resume");
+		}
+
+		if (resume.getValue() && !usedMapFileName.getValue().empty())
+		{
+			throw TCLAP::ArgException("cannot be used with a shared used map, whose claims made after the checkpoint are not recorded", "resume");
+		}
+
+		if (!loadIndexFileName.getValue().empty() && partitions.getValue() > 1)
+		{
+			throw TCLAP::ArgException("an incremental run cannot be partitioned", "load-index");
+		}
 
 		std::cout << "Loading the graph..." << std::endl;
-		Sibelia::JunctionStorage storage(inFileName.getValue(),
-			genomesFileName.getValue(),
-			kvalue.getValue(),
-			threads.getValue(),
-			abundanceThreshold.getValue(),
-			0);
+		Sibelia::RunReport report;
+		Sibelia::LcbIndex baseline;
+		std::unique_ptr<Sibelia::JunctionStorage> storagePtr(new Sibelia::JunctionStorage(kvalue.getValue()));
+		storagePtr->SetReport(&report);
+		storagePtr->SetRepeatAbundance(repeatAbundance.getValue());
+		if (buildGraph.getValue())
+		{
+			storagePtr->InitFromGenomes(genomesFileName.getValue(), threads.getValue(), abundanceThreshold.getValue());
+		}
+		else if (loadIndexFileName.getValue().empty())
+		{
+			storagePtr->Init(inFileName.getValue(),
+				genomesFileName.getValue(),
+				threads.getValue(),
+				abundanceThreshold.getValue(),
+				0,
+				graphStream.getValue() || inFileName.getValue() == "-");
+		}
+		else
+		{
+			{
+				Sibelia::RunReport::Phase phase(&report, "load_index");
+				baseline.Load(loadIndexFileName.getValue());
+			}
+
+			storagePtr->InitIncremental(baseline, genomesFileName.getValue(), inFileName.getValue(), threads.getValue(), abundanceThreshold.getValue());
+		}
+
+		Sibelia::JunctionStorage & storage = *storagePtr;
+
+		std::unique_ptr<Sibelia::SharedUsedMap> usedMap;
+		if (!usedMapFileName.getValue().empty())
+		{
+			usedMap.reset(new Sibelia::SharedUsedMap(usedMapFileName.getValue(), storage.GetPositionsNumber(), partition.getValue(), partitions.getValue()));
+			storage.AttachUsedMap(usedMap.get());
+		}
+
+		Sibelia::NumaTopology topology(numaNodes.getValue());
+		if (numa.getValue() || numaNodes.getValue() > 0)
+		{
+			std::cout << "Distributing the graph over " << topology.GetNodesNumber() << (topology.IsEmulated() ? " emulated" : "") << " NUMA nodes..." << std::endl;
+			Sibelia::RunReport::Phase phase(&report, "numa_distribute");
+			storage.Distribute(topology);
+		}
 
 		std::cout << "Analyzing the graph..." << std::endl;
 		Sibelia::BlocksFinder finder(storage, kvalue.getValue());
+		finder.SetReport(&report);
+		finder.SetPruning(prune.getValue());
+		finder.SetBundles(bundles.getValue());
+		finder.SetAlignment(align.getValue(), alignThreads.getValue(), uint64_t(alignMemory.getValue()) << 20);
+		finder.SetAnchoredAlignment(anchorLength.getValue());
+		finder.SetMafCompression(compressMaf.getValue());
+		finder.SetPartition(partition.getValue(), partitions.getValue());
+		finder.SetCheckpoint(checkpointFileName.getValue(), checkpointInterval.getValue(), resume.getValue());
+		finder.SetStatus(statusFileName.getValue(), statusInterval.getValue());
+		if (!loadIndexFileName.getValue().empty())
+		{
+			finder.SetBaseline(&baseline);
+		}
+
+		if (numa.getValue() || numaNodes.getValue() > 0)
+		{
+			finder.SetNumaTopology(&topology);
+		}
+
+		Sibelia::RegionSet regions;
+		if (!regionsFileName.getValue().empty())
+		{
+			regions.Load(regionsFileName.getValue(), storage);
+			finder.SetRegions(&regions);
+		}
+
+		if (serve)
+		{
+			Sibelia::LcbServer::Parameters defaults;
+			defaults.minBlockSize = minBlockSize.getValue();
+			defaults.maxBranchSize = maxBranchSize.getValue();
+			defaults.threads = threads.getValue();
+			defaults.genSeq = !noSeq.getValue();
+			defaults.sortById = !noSort.getValue();
+			Sibelia::LcbServer lcbServer(storage, finder, defaults);
+			if (socketFileName.getValue().empty())
+			{
+				lcbServer.Serve(std::cin, answer);
+			}
+			else
+			{
+				lcbServer.Serve(socketFileName.getValue());
+			}
+
+			return 0;
+		}
+
 		finder.FindBlocks(minBlockSize.getValue(),
 			maxBranchSize.getValue(),
 			maxBranchSize.getValue(),
@@ -134,7 +466,14 @@ int main(int argc, char * argv[])
 			outDirName.getValue() + "/paths.txt");
 
 		std::cout << "Generating the output..." << std::endl;
-		finder.GenerateOutput(outDirName.getValue(), !noSeq.getValue());
+		finder.GenerateOutput(outDirName.getValue(), !noSeq.getValue(), !noSort.getValue());
+		if (!saveIndexFileName.getValue().empty())
+		{
+			Sibelia::RunReport::Phase phase(&report, "save_index");
+			finder.SaveIndex(saveIndexFileName.getValue());
+		}
+
+		report.Write(outDirName.getValue() + "/run_report.json", threads.getValue());
 	}
 	catch (TCLAP::ArgException & e)
 	{
@@ -0,0 +1,152 @@
+#ifndef _SYNTHETIC_GENOMES_H_
+#define _SYNTHETIC_GENOMES_H_
+
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+
+#include <junctionapi.h>
+
+#include "kmerjunctions.h"
+#include "compactjunctions.h"
+
+namespace Sibelia
+{
+	// Genomes evolved from a random ancestor, for benchmarks. A share of the
+	// ancestor is covered by diverged copies of a few repeat units, then every
+	// genome gets its own substitutions and 1-5 bp indels, an indel being ten
+	// times rarer than a substitution.
+	class SyntheticGenomes
+	{
+	public:
+		struct Options
+		{
+			size_t genomes;
+			size_t length;
+			double divergence;
+			double repeats;
+			size_t repeatLength;
+			size_t repeatFamilies;
+			double repeatDivergence;
+			uint64_t seed;
+
+			Options() : genomes(8), length(1000000), divergence(0.01), repeats(0.05), repeatLength(500), repeatFamilies(10), repeatDivergence(0.05), seed(1)
+			{
+
+			}
+		};
+
+		SyntheticGenomes(const Options & options) : random_(options.seed)
+		{
+			std::string ancestor = RandomSequence(options.length);
+			std::vector<std::string> unit;
+			for (size_t i = 0; i < options.repeatFamilies && options.repeatLength < options.length; i++)
+			{
+				unit.push_back(RandomSequence(options.repeatLength));
+			}
+
+			size_t copies = unit.empty() ? 0 : size_t(options.repeats * options.length / options.repeatLength);
+			for (size_t i = 0; i < copies; i++)
+			{
+				std::string copy = Mutate(unit[random_() % unit.size()], options.repeatDivergence);
+				size_t pos = random_() % (ancestor.size() - copy.size());
+				ancestor.replace(pos, copy.size(), copy);
+			}
+
+			for (size_t i = 0; i < options.genomes; i++)
+			{
+				sequence_.push_back(Mutate(ancestor, options.divergence));
+			}
+		}
+
+		const std::vector<std::string> & GetSequences() const
+		{
+			return sequence_;
+		}
+
+		void WriteFasta(const std::string & fileName) const
+		{
+			std::ofstream out(fileName.c_str());
+			for (size_t i = 0; i < sequence_.size(); i++)
+			{
+				out << ">g" << i << '\n';
+				for (size_t j = 0; j < sequence_[i].size(); j += 80)
+				{
+					out << sequence_[i].substr(j, 80) << '\n';
+				}
+			}
+
+			if (!out)
+			{
+				throw std::runtime_error(("Cannot write " + fileName).c_str());
+			}
+		}
+
+		// Writes in the compact format the junctions TwoPaCo would find
+		void WriteJunctions(const std::string & fileName, size_t k, int64_t threads = 1) const
+		{
+			CompactJunctionWriter writer(fileName);
+			KmerJunctionFinder(k).Find(sequence_, threads, [&writer](const TwoPaCo::JunctionPosition & junction) { writer.WriteJunction(junction); });
+			writer.Close();
+		}
+
+	private:
+		std::string RandomSequence(size_t length)
+		{
+			std::string ret(length, 'A');
+			for (char & ch : ret)
+			{
+				ch = "ACGT"[random_() % 4];
+			}
+
+			return ret;
+		}
+
+		std::string Mutate(const std::string & source, double rate)
+		{
+			std::string ret;
+			ret.reserve(source.size() + source.size() / 10);
+			std::uniform_real_distribution<double> uniform(0, 1);
+			for (size_t i = 0; i < source.size(); i++)
+			{
+				double dice = uniform(random_);
+				if (dice < rate / 10)
+				{
+					size_t length = random_() % 5 + 1;
+					if (random_() % 2)
+					{
+						ret += RandomSequence(length);
+						ret.push_back(source[i]);
+					}
+					else
+					{
+						i += length - 1;
+					}
+				}
+				else if (dice < rate)
+				{
+					ret.push_back("ACGT"[(Code(source[i]) + random_() % 3 + 1) % 4]);
+				}
+				else
+				{
+					ret.push_back(source[i]);
+				}
+			}
+
+			return ret;
+		}
+
+		static int Code(char ch)
+		{
+			return ch == 'A' ? 0 : (ch == 'C' ? 1 : (ch == 'G' ? 2 : 3));
+		}
+
+		std::mt19937_64 random_;
+		std::vector<std::string> sequence_;
+	};
+}
+
+#endif
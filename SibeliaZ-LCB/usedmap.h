@@ -0,0 +1,131 @@
+#ifndef _USED_MAP_H_
+#define _USED_MAP_H_
+
+#include <string>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace Sibelia
+{
+	// A bitmap of used positions kept in a file mapped by every process of a
+	// distributed run. Bits are claimed with atomic read-modify-write on the
+	// shared mapping, so two processes can never both claim the same position.
+	//
+	// The file starts with a header holding the number of bits and partitions
+	// and the partitions that joined the run. A process joins under an flock,
+	// creating the header if the file is new. A file of another input, or one
+	// its partition already joined, is left from an earlier run and refused.
+	// A partition can't rejoin: its claims made after the last checkpoint are
+	// not recorded anywhere, so resuming would lose those positions.
+	class SharedUsedMap
+	{
+	public:
+		SharedUsedMap(const std::string & fileName, uint64_t bits, uint64_t partition, uint64_t partitions) : words_((bits + 63) / 64)
+		{
+			fd_ = open(fileName.c_str(), O_RDWR | O_CREAT, 0644);
+			if (fd_ == -1)
+			{
+				throw std::runtime_error(("Cannot open the used map " + fileName).c_str());
+			}
+
+			uint64_t headerWords = HEADER_WORDS + (partitions + 63) / 64;
+			size_t bytes = (headerWords + words_) * sizeof(uint64_t);
+			struct stat st;
+			if (flock(fd_, LOCK_EX) != 0 || fstat(fd_, &st) != 0)
+			{
+				close(fd_);
+				throw std::runtime_error(("Cannot lock the used map " + fileName).c_str());
+			}
+
+			bool created = st.st_size == 0;
+			if ((!created && size_t(st.st_size) != bytes) || (created && ftruncate(fd_, bytes) != 0))
+			{
+				close(fd_);
+				throw std::runtime_error(("The used map " + fileName + " was made for another input or partitioning, remove it").c_str());
+			}
+
+			void * data = mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+			if (data == MAP_FAILED)
+			{
+				close(fd_);
+				throw std::runtime_error(("Cannot map the used map " + fileName).c_str());
+			}
+
+			bytes_ = bytes;
+			header_ = static_cast<uint64_t*>(data);
+			word_ = header_ + headerWords;
+			if (created)
+			{
+				header_[0] = MAGIC;
+				header_[1] = bits;
+				header_[2] = partitions;
+			}
+
+			uint64_t & joined = header_[HEADER_WORDS + partition / 64];
+			uint64_t mask = uint64_t(1) << (partition & 63);
+			const char * error = 0;
+			if (header_[0] != MAGIC || header_[1] != bits || header_[2] != partitions)
+			{
+				error = " was made for another input or partitioning, remove it";
+			}
+			else if ((joined & mask) != 0)
+			{
+				error = " is left from an earlier run of this partition, remove it";
+			}
+
+			joined |= error == 0 ? mask : 0;
+			flock(fd_, LOCK_UN);
+			if (error != 0)
+			{
+				munmap(header_, bytes_);
+				close(fd_);
+				throw std::runtime_error(("The used map " + fileName + error).c_str());
+			}
+		}
+
+		~SharedUsedMap()
+		{
+			munmap(header_, bytes_);
+			close(fd_);
+		}
+
+		bool Test(uint64_t bit) const
+		{
+			return (__atomic_load_n(word_ + (bit >> 6), __ATOMIC_RELAXED) >> (bit & 63)) & 1;
+		}
+
+		bool Claim(uint64_t bit)
+		{
+			uint64_t mask = uint64_t(1) << (bit & 63);
+			return (__atomic_fetch_or(word_ + (bit >> 6), mask, __ATOMIC_ACQ_REL) & mask) == 0;
+		}
+
+		void Release(uint64_t bit)
+		{
+			uint64_t mask = uint64_t(1) << (bit & 63);
+			__atomic_fetch_and(word_ + (bit >> 6), ~mask, __ATOMIC_ACQ_REL);
+		}
+
+	private:
+		static const uint64_t MAGIC = 0x50414d4445535553ULL;
+		static const uint64_t HEADER_WORDS = 3;
+
+		SharedUsedMap(const SharedUsedMap &);
+		SharedUsedMap & operator = (const SharedUsedMap &);
+
+		int fd_;
+		size_t bytes_;
+		uint64_t words_;
+		uint64_t * word_;
+		uint64_t * header_;
+	};
+}
+
+#endif